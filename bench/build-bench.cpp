@@ -0,0 +1,259 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <build.hpp>
+#include <backend/fake-backend.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <random>
+#include <string>
+#include <charconv>
+#endif
+
+// End-to-end benchmark of all Harmony phases over a generated synthetic project. Compilation uses the fake backend,
+// so results only measure Harmony itself and are deterministic on any machine.
+//
+// Usage: harmony-bench-build [key=value...]
+//   sources=1000 c-sources=100 modules=200 header-units=20 headers=100 depth=8 fan-out=4 targets=4 iterations=3
+
+struct SyntheticProject
+{
+    uint32_t sources = 1000;
+    uint32_t c_sources = 100;
+    uint32_t modules = 200;
+    uint32_t header_units = 20;
+    uint32_t headers = 100;
+    uint32_t depth = 8;
+    uint32_t fan_out = 4;
+    uint32_t targets = 4;
+};
+
+// Write the project to disk and return its build configuration. Files are only rewritten on change, so repeated
+// runs with the same parameters don't invalidate previous outputs
+static
+std::string GenerateSyntheticProject(const SyntheticProject& project, const fs::path& root)
+{
+    std::mt19937 rng(0);
+    auto Random = [&](uint32_t count) {
+        return std::uniform_int_distribution<uint32_t>(0, count - 1)(rng);
+    };
+
+    auto common_dir = root / "common";
+    fs::create_directories(common_dir / "modules");
+    fs::create_directories(common_dir / "include");
+
+    uint32_t files_written = 0;
+    auto Write = [&](const fs::path& path, std::string_view contents) {
+        if (WriteFileIfChanged(path, contents)) files_written++;
+    };
+
+    // Headers, each including at most one earlier header to form shallow chains
+
+    for (uint32_t i = 0; i < project.headers; ++i) {
+        std::string contents = "#pragma once\n";
+        if (i > 0) contents += std::format("#include \"h{}.hpp\"\n", Random(i));
+        contents += std::format("inline int h{0}_value() {{ return {0}; }}\n", i);
+        Write(common_dir / "include" / std::format("h{}.hpp", i), contents);
+    }
+
+    // Header units
+
+    for (uint32_t i = 0; i < project.header_units; ++i) {
+        Write(common_dir / "include" / std::format("hu{}.hpp", i),
+            std::format("#pragma once\ninline int hu{0}_value() {{ return {0}; }}\n", i));
+    }
+
+    // Modules in layers, each importing up to fan-out modules from the layer below
+
+    auto depth = std::max(1u, std::min(project.depth, project.modules));
+    auto LayerBegin = [&](uint32_t layer) { return uint32_t(uint64_t(layer) * project.modules / depth); };
+
+    for (uint32_t layer = 0; layer < depth; ++layer) {
+        for (uint32_t i = LayerBegin(layer); i < LayerBegin(layer + 1); ++i) {
+            std::string contents = "module;\n";
+            if (project.headers) contents += std::format("#include \"h{}.hpp\"\n", Random(project.headers));
+            contents += std::format("export module m{};\n", i);
+            if (project.header_units) contents += std::format("import \"hu{}.hpp\";\n", Random(project.header_units));
+            if (layer > 0) {
+                auto below = LayerBegin(layer - 1);
+                auto count = LayerBegin(layer) - below;
+                for (uint32_t j = 0; j < std::min(project.fan_out, count); ++j) {
+                    contents += std::format("import m{};\n", below + Random(count));
+                }
+            }
+            contents += std::format("export int m{0}_value() {{ return {0}; }}\n", i);
+            Write(common_dir / "modules" / std::format("m{}.ixx", i), contents);
+        }
+    }
+
+    // Sources spread over executable targets
+
+    auto num_targets = std::max(1u, project.targets);
+    for (uint32_t t = 0; t < num_targets; ++t) {
+        fs::create_directories(root / std::format("app{}", t) / "src");
+    }
+
+    for (uint32_t i = 0; i < project.sources; ++i) {
+        std::string contents;
+        for (uint32_t j = 0; j < std::min(project.fan_out, project.headers); ++j) {
+            contents += std::format("#include \"h{}.hpp\"\n", Random(project.headers));
+        }
+        if (project.header_units) contents += std::format("import \"hu{}.hpp\";\n", Random(project.header_units));
+        for (uint32_t j = 0; j < std::min(project.fan_out, project.modules); ++j) {
+            contents += std::format("import m{};\n", Random(project.modules));
+        }
+        contents += std::format("int s{0}_value() {{ return {0}; }}\n", i);
+        Write(root / std::format("app{}", i % num_targets) / "src" / std::format("s{}.cpp", i), contents);
+    }
+
+    // Plain C sources of a vendored library, which are compiled in batches
+
+    auto vendor_dir = root / "vendor";
+    fs::create_directories(vendor_dir / "src");
+    for (uint32_t i = 0; i < project.c_sources; ++i) {
+        Write(vendor_dir / "src" / std::format("v{}.c", i), std::format("int v{0}_value(void) {{ return {0}; }}\n", i));
+    }
+
+    LogInfo("Generated synthetic project in [{}] ({} files written)", root.string(), files_written);
+
+    std::string config = std::format(R"({{ "targets": [ {{ "name": "common", "dir": "{}", "sources": [ "modules", "include" ], "include": [ "include" ] }})",
+        common_dir.generic_string());
+    config += std::format(R"(, {{ "name": "vendor", "dir": "{}", "sources": [ "src" ] }})", vendor_dir.generic_string());
+    for (uint32_t t = 0; t < num_targets; ++t) {
+        config += std::format(R"(, {{ "name": "app{0}", "dir": "{1}", "sources": [ "src" ], "import": [ "common", "vendor" ], "executable": {{}} }})",
+            t, (root / std::format("app{}", t)).generic_string());
+    }
+    config += " ] }";
+
+    return config;
+}
+
+static
+uint32_t ParseUint(std::string_view value)
+{
+    uint32_t result = 0;
+    auto[ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (ec != std::errc{} || ptr != value.data() + value.size()) Error("Invalid number: [{}]", value);
+    return result;
+}
+
+int main(int argc, char* argv[]) try
+{
+    SyntheticProject project;
+    uint32_t iterations = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto equals = arg.find('=');
+        if (equals == std::string_view::npos) Error("Expected key=value, got [{}]", arg);
+        auto key = arg.substr(0, equals);
+        auto value = ParseUint(arg.substr(equals + 1));
+
+        if      (key == "sources")      project.sources = value;
+        else if (key == "c-sources")    project.c_sources = value;
+        else if (key == "modules")      project.modules = value;
+        else if (key == "header-units") project.header_units = value;
+        else if (key == "headers")      project.headers = value;
+        else if (key == "depth")        project.depth = value;
+        else if (key == "fan-out")      project.fan_out = value;
+        else if (key == "targets")      project.targets = value;
+        else if (key == "iterations")   iterations = value;
+        else Error("Unknown parameter: [{}]", key);
+    }
+
+    auto root = HarmonyTempDir / "bench-build" / std::format("s{}-c{}-m{}-hu{}-h{}-d{}-f{}-t{}",
+        project.sources, project.c_sources, project.modules, project.header_units, project.headers,
+        project.depth, project.fan_out, project.targets);
+
+    auto config = GenerateSyntheticProject(project, root / "project");
+
+    log_level = LogLevel::Warn;
+
+    FakeBackend backend;
+    backend.out_dir = root / "out";
+
+    std::vector<std::pair<std::string, std::vector<chr::steady_clock::duration>>> results;
+    auto Record = [&](std::string_view name, chr::steady_clock::duration duration) {
+        auto iter = std::ranges::find(results, name, [](auto& result) -> std::string_view { return result.first; });
+        if (iter == results.end()) iter = results.emplace(results.end(), std::string(name), std::vector<chr::steady_clock::duration>{});
+        iter->second.emplace_back(duration);
+    };
+
+    size_t num_tasks = 0;
+    uint32_t num_batches = 0;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        // Each iteration measures a clean build followed by a no-op build
+        fs::remove_all(backend.out_dir);
+        auto build_log = root / "build-log.json";
+        fs::remove(build_log);
+
+        for (auto build : { "build (clean)", "build (no-op)" }) {
+            BuildState state;
+            state.backend = &backend;
+            state.options.build_log = build_log;
+            state.targets["std"].name = "std";
+
+            auto RunPhase = [&](std::string_view name, auto&& fn) {
+                auto start = chr::steady_clock::now();
+                fn();
+                Record(name, chr::steady_clock::now() - start);
+            };
+
+            RunPhase("parse", [&] { ParseTargetsFile(state, config); });
+            RunPhase("expand", [&] { ExpandTargets(state); });
+            RunPhase("scan", [&] {
+                ScanDependencies(state, false);
+                GenerateUnityBatches(state);
+                DetectAndInsertStdModules(state);
+                SplitModuleCompilation(state);
+                GeneratePrecompiledHeaders(state);
+            });
+            RunPhase("sort", [&] { SortDependencies(state); });
+            RunPhase("flatten", [&] { Flatten(state); });
+            RunPhase(build, [&] {
+                if (!Build(state)) Error("Synthetic build failed");
+            });
+
+            // Batches must run as a single invocation, otherwise they only add overhead
+            if (state.stats.batch_fallbacks) {
+                Error("{} / {} batches were compiled per task", state.stats.batch_fallbacks, state.stats.batches);
+            }
+            num_batches = std::max(num_batches, state.stats.batches);
+
+            num_tasks = state.tasks.size();
+        }
+    }
+
+    log_level = LogLevel::Info;
+
+    LogInfo("Synthetic project: {} sources, {} C sources, {} modules, {} header units, {} headers, depth {}, fan-out {}, {} targets",
+        project.sources, project.c_sources, project.modules, project.header_units, project.headers,
+        project.depth, project.fan_out, project.targets);
+    LogInfo("  {} tasks, {} batched invocations, {} iterations", num_tasks, num_batches, iterations);
+
+    for (auto&[name, durations] : results) {
+        auto min = std::ranges::min(durations);
+        chr::steady_clock::duration total{};
+        for (auto& duration : durations) total += duration;
+        auto mean = total / durations.size();
+        LogInfo("  {:<16} min = {:>8}  mean = {:>8}  per task = {}", name,
+            DurationToString(min), DurationToString(mean),
+            DurationToString(chr::duration<double, std::nano>(min) / std::max<size_t>(1, num_tasks)));
+    }
+
+    LogFlush();
+}
+catch (const std::exception& e)
+{
+    LogError("{}", e.what());
+    LogFlush();
+    return 1;
+}
+catch (HarmonySilentException)
+{
+    LogFlush();
+    return 1;
+}
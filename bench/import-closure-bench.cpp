@@ -0,0 +1,94 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <build.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <random>
+#include <string>
+#endif
+
+// Measures ExpandTargets and Flatten for configurations with many interdependent targets
+//
+// Usage: harmony-bench-imports [targets = 500] [fan out = 8] [iterations = 10]
+
+static
+std::string GenerateConfig(uint32_t num_targets, uint32_t fan_out, const fs::path& root)
+{
+    std::mt19937 rng(0);
+
+    std::string config = R"({ "targets": [)";
+    for (uint32_t i = 0; i < num_targets; ++i) {
+        if (i > 0) config += ',';
+        config += std::format(R"({{ "name": "t{0}", "dir": "{1}", "sources": [ "src" ],)"
+                              R"( "include": [ "include", "include/t{0}" ], "define": [ "T{0}=1", "SHARED=1" ])",
+            i, (root / std::format("t{}", i)).generic_string());
+
+        // Only import earlier targets to keep the graph acyclic
+        if (i > 0) {
+            static constexpr std::string_view ImportKeys[] { "import", "import-public", "import-interface" };
+            for (auto key : ImportKeys) {
+                config += std::format(R"(, "{}": [)", key);
+                auto count = std::uniform_int_distribution<uint32_t>(0, fan_out / 2)(rng);
+                for (uint32_t j = 0; j < count; ++j) {
+                    if (j > 0) config += ',';
+                    config += std::format(R"("t{}")", std::uniform_int_distribution<uint32_t>(0, i - 1)(rng));
+                }
+                config += ']';
+            }
+        }
+
+        config += " }";
+    }
+    config += "] }";
+
+    return config;
+}
+
+int main(int argc, char* argv[]) try
+{
+    uint32_t num_targets = argc > 1 ? uint32_t(std::stoul(argv[1])) : 500;
+    uint32_t fan_out     = argc > 2 ? uint32_t(std::stoul(argv[2])) : 8;
+    uint32_t iterations  = argc > 3 ? uint32_t(std::stoul(argv[3])) : 10;
+
+    log_level = LogLevel::Warn;
+
+    auto config = GenerateConfig(num_targets, fan_out, HarmonyTempDir / "bench-imports");
+
+    chr::duration<double, std::nano> expand_total{}, flatten_total{};
+    chr::duration<double, std::nano> expand_min = chr::hours(1), flatten_min = chr::hours(1);
+    size_t interned_inputs = 0;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        BuildState state;
+        state.targets["std"].name = "std";
+        ParseTargetsFile(state, config);
+
+        auto start = chr::steady_clock::now();
+        ExpandTargets(state);
+        auto expanded = chr::steady_clock::now();
+        Flatten(state);
+        auto end = chr::steady_clock::now();
+
+        expand_total += expanded - start;
+        flatten_total += end - expanded;
+        expand_min = std::min<chr::duration<double, std::nano>>(expand_min, expanded - start);
+        flatten_min = std::min<chr::duration<double, std::nano>>(flatten_min, end - expanded);
+        interned_inputs = state.translation_inputs.entries.size();
+    }
+
+    log_level = LogLevel::Info;
+    LogInfo("Targets = {}, fan out = {}, iterations = {}, interned inputs = {}", num_targets, fan_out, iterations, interned_inputs);
+    LogInfo("  ExpandTargets: avg = {}, min = {}", DurationToString(expand_total / iterations), DurationToString(expand_min));
+    LogInfo("  Flatten:       avg = {}, min = {}", DurationToString(flatten_total / iterations), DurationToString(flatten_min));
+}
+catch (const std::exception& e)
+{
+    LogError("{}", e.what());
+}
+catch (HarmonySilentException)
+{
+    // do nothing
+}
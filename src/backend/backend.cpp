@@ -0,0 +1,127 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "backend.hpp"
+
+#include <xxhash.h>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <atomic>
+#include <unordered_set>
+#endif
+
+static const fs::path ResponseFileDir = HarmonyTempDir / "rsp";
+
+// Response files are named by their contents, so identical commands reuse the same file across builds and
+// generated command lines stay stable
+static
+fs::path WriteResponseFile(std::span<const char* const> args)
+{
+    std::string contents;
+    for (uint32_t i = 0; i < args.size(); ++i) {
+        if (i > 0) contents += '\n';
+        contents += QuoteResponseFileArgument(args[i]);
+    }
+
+    auto path = ResponseFileDir / std::format("{:016x}.rsp", XXH64(contents.data(), contents.size(), 0));
+    if (!fs::exists(path)) {
+        static std::atomic_uint32_t temp_id = 0;
+        fs::create_directories(ResponseFileDir);
+        auto temp_path = ResponseFileDir / std::format("rsp.{}.tmp", temp_id++);
+        WriteStringToFile(temp_path, contents);
+        fs::rename(temp_path, path);
+    }
+    return path;
+}
+
+static
+std::string ResponseFileArg(std::span<const char* const> args)
+{
+    return std::format("@{}", FormatPath(WriteResponseFile(args), PathFormatOptions::Absolute));
+}
+
+std::string Command::ToString() const
+{
+    std::string cmdline;
+    for (auto arg : Args()) {
+        if (!cmdline.empty()) cmdline += ' ';
+        cmdline += QuoteArgument(arg);
+    }
+    return cmdline;
+}
+
+std::string Command::ToString(size_t max_length) const
+{
+    auto cmdline = ToString();
+    if (cmdline.size() <= max_length || arg_offsets.size() < 2) return cmdline;
+
+    auto args = Args();
+    return std::format("{} {}", QuoteArgument(args[0]), QuoteArgument(ResponseFileArg(std::span(args).subspan(1))));
+}
+
+std::vector<const char*> ExecutionArgs(const Command& command, std::string& response_arg)
+{
+    auto args = command.Args();
+    if (args.size() < 2 || FitsCommandLine(args)) return args;
+
+    response_arg = ResponseFileArg(std::span(args).subspan(1));
+    return { args[0], response_arg.c_str() };
+}
+
+bool ExecuteCommand(const Command& command)
+{
+    if (!command.working_dir.empty()) fs::create_directories(command.working_dir);
+    if (TraceCmds) LogCmd(command.ToString());
+
+    std::string response_arg;
+    return RunCommand(ExecutionArgs(command, response_arg), command.working_dir) == 0;
+}
+
+void ForEachObject(const Backend& backend, const Target& target, std::span<const Task> tasks, function_ref<void(const fs::path&)> callback)
+{
+    for (auto& task : tasks) {
+        if (task.target != &target || !backend.LinksObject(task)) continue;
+        callback(task.obj);
+    }
+}
+
+void ForEachImportedLibrary(const Backend& backend, const Target& target, std::span<const Task> tasks,
+    function_ref<void(const Target& library, const fs::path& path)> callback)
+{
+    std::unordered_set<const Target*> with_objects;
+    for (auto& task : tasks) {
+        if (backend.LinksObject(task)) with_objects.emplace(task.target);
+    }
+
+    // Imports of a shared library are already linked into it, so the walk doesn't continue past shared libraries
+
+    std::vector<const Target*> libraries;
+    std::unordered_set<const Target*> visited;
+    auto Visit = [&](this auto&& self, const Target& cur) -> void {
+        for (auto[imported, _] : cur.resolved_imports) {
+            if (!visited.emplace(imported).second) continue;
+            if (with_objects.contains(imported) && !imported->executable) libraries.emplace_back(imported);
+            if (!imported->shared_library) self(*imported);
+        }
+    };
+    Visit(target);
+
+    // Archives also imported directly are already linked into an imported shared library, linking them again would
+    // duplicate their globals. Their symbols are used through the shared library instead
+
+    std::unordered_set<const Target*> linked_into_shared;
+    for (auto* library : libraries) {
+        if (library->shared_library) linked_into_shared.insert(library->flattened_imports.begin(), library->flattened_imports.end());
+    }
+    std::erase_if(libraries, [&](const Target* library) {
+        return !library->shared_library && linked_into_shared.contains(library);
+    });
+
+    std::ranges::sort(libraries, {}, &Target::name);
+
+    for (auto* imported : libraries) {
+        callback(*imported, imported->shared_library ? backend.SharedLibraryLinkPath(*imported) : backend.ArchivePath(*imported));
+    }
+}
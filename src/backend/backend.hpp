@@ -6,8 +6,89 @@
 #ifndef HARMONY_USE_IMPORT_STD
 #include <span>
 #include <random>
+#include <iterator>
 #endif
 
+// A single toolchain invocation
+struct Command
+{
+    fs::path working_dir;
+
+    // Program followed by its arguments. Arguments are stored unquoted and null terminated in a single buffer, so
+    // building a command doesn't allocate per argument and the arguments can be passed to the OS directly
+    std::string arg_data;
+    std::vector<uint32_t> arg_offsets;
+
+    // Files written by the command, primary output first
+    std::vector<fs::path> outputs;
+
+    void Add(std::string_view arg)
+    {
+        arg_offsets.emplace_back(uint32_t(arg_data.size()));
+        arg_data += arg;
+        arg_data += '\0';
+    }
+
+    template<class... Args>
+    void AddFormat(std::format_string<Args...> fmt, Args&&... args)
+    {
+        arg_offsets.emplace_back(uint32_t(arg_data.size()));
+        std::format_to(std::back_inserter(arg_data), fmt, std::forward<Args>(args)...);
+        arg_data += '\0';
+    }
+
+    // Add an absolute path argument following an optional prefix (e.g. "-I")
+    void AddPath(std::string_view prefix, const fs::path& path, PathFormatOptions separators = PathFormatOptions::Forward)
+    {
+        arg_offsets.emplace_back(uint32_t(arg_data.size()));
+        arg_data += prefix;
+        arg_data += FormatPath(path, separators | PathFormatOptions::Absolute);
+        arg_data += '\0';
+    }
+
+    // Pointers to each argument, valid until the command is next modified
+    std::vector<const char*> Args() const
+    {
+        std::vector<const char*> args(arg_offsets.size());
+        for (uint32_t i = 0; i < arg_offsets.size(); ++i) {
+            args[i] = arg_data.data() + arg_offsets[i];
+        }
+        return args;
+    }
+
+    // Quoted command line, for logging, compilation databases and generated build files
+    std::string ToString() const;
+
+    // Quoted command line, with all arguments moved into a response file if the line would exceed max_length
+    std::string ToString(size_t max_length) const;
+};
+
+// Arguments to execute a command with. Arguments are moved into a content addressed response file (kept in
+// response_arg) only if they exceed the OS command line limit
+std::vector<const char*> ExecutionArgs(const Command& command, std::string& response_arg);
+
+bool ExecuteCommand(const Command& command);
+
+struct Backend;
+
+// How a compile command reports the headers it reads
+enum class HeaderDependencyFormat : uint8_t
+{
+    None,
+    // Make style depfile, written next to the primary output with a ".d" suffix
+    Gcc,
+    // /showIncludes notes printed by the compiler
+    Msvc,
+};
+
+// Objects of a target's own tasks, linked into its executable or archived for importers
+void ForEachObject(const Backend& backend, const Target& target, std::span<const Task> tasks, function_ref<void(const fs::path&)> callback);
+
+// Libraries of all imported targets that have objects, ordered by target name. Archives, or the file to link
+// against for shared library targets. Targets linked into an imported shared library are skipped
+void ForEachImportedLibrary(const Backend& backend, const Target& target, std::span<const Task> tasks,
+    function_ref<void(const Target& library, const fs::path& path)> callback);
+
 struct Backend {
     virtual ~Backend() = 0;
 
@@ -25,31 +106,132 @@ struct Backend {
         Error("GenerateStdModuleTasks is not implemented");
     }
 
+    // Compile module interfaces in two tasks (BMI, then object), so that importers can start before codegen
+    virtual bool SplitsModuleCompilation() const
+    {
+        return false;
+    }
+
+    // Build shared global module fragment prefixes (BuildOptions::auto_pch) as precompiled headers
+    virtual bool SupportsPrecompiledHeaders() const
+    {
+        return false;
+    }
+
+    // Translate includes of header units referenced by a task into imports (BuildOptions::promote_header_units)
+    virtual bool SupportsIncludeTranslation() const
+    {
+        return false;
+    }
+
+    // Link shared library targets. Backends that would require explicitly exported symbols don't support them
+    virtual bool SupportsSharedLibraries() const
+    {
+        return false;
+    }
+
     virtual void AddTaskInfo(std::span<Task> tasks) const
     {
         HARMONY_IGNORE(tasks)
         Error("AddTaskInfo is not implemented");
     }
 
-    virtual bool CompileTask(const Task& task) const
+    virtual Command GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const
     {
         HARMONY_IGNORE(task)
-        Error("CompileTask is not implemented");
+        HARMONY_IGNORE(tasks)
+        Error("GenerateCompileCommand is not implemented");
     }
 
-    virtual bool LinkStep(Target& target, std::span<const Task> tasks) const
+    // Make a compile command report the headers it reads, so that generated builds can track them
+    virtual HeaderDependencyFormat AddHeaderDependencyFlags(Command& command) const
+    {
+        HARMONY_IGNORE(command)
+        return HeaderDependencyFormat::None;
+    }
+
+    virtual Command GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const
     {
         HARMONY_IGNORE(target)
         HARMONY_IGNORE(tasks)
-        Error("LinkStep is not implemented");
+        Error("GenerateLinkCommand is not implemented");
     }
 
-    virtual void GenerateCompileCommands(std::span<const Task> tasks) const
+    virtual bool CompileTask(const Task& task, std::span<const Task> tasks) const
     {
-        // TODO: Control where output goes
-        HARMONY_IGNORE(tasks)
-        Error("GenerateCompileCommands is not implemented");
-    };
+        return ExecuteCommand(GenerateCompileCommand(task, tasks));
+    }
+
+    // Maximum number of tasks passed to CompileTaskBatch, 1 if the backend can't compile several sources at once
+    virtual uint32_t MaxCompileBatchSize() const
+    {
+        return 1;
+    }
+
+    // Compile tasks without dependencies that share target, translation inputs and source type, ideally in a single
+    // compiler invocation to amortize process startup. Returns the result of each task, a failed invocation must be
+    // retried per task so that failures are attributed to the right sources
+    virtual std::vector<bool> CompileTaskBatch(std::span<const uint32_t> batch, std::span<const Task> tasks) const
+    {
+        std::vector<bool> results;
+        for (auto index : batch) results.emplace_back(CompileTask(tasks[index], tasks));
+        return results;
+    }
+
+    // Whether the object of a task is linked, tasks that only produce a BMI have nothing to link
+    virtual bool LinksObject(const Task& task) const
+    {
+        return task.kind != TaskKind::Precompile && task.kind != TaskKind::PrecompiledHeader && !task.is_header_unit;
+    }
+
+    // Static library of the objects of a target that isn't an executable, linked by importers instead of the objects
+    virtual fs::path ArchivePath(const Target& target) const
+    {
+        HARMONY_IGNORE(target)
+        Error("ArchivePath is not implemented");
+    }
+
+    // Create an archive from objects, or with update replace only the given members of an existing archive
+    virtual Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const
+    {
+        HARMONY_IGNORE(target)
+        HARMONY_IGNORE(objects)
+        HARMONY_IGNORE(update)
+        Error("GenerateArchiveCommand is not implemented");
+    }
+
+    virtual bool ArchiveStep(const Target& target, std::span<const fs::path> objects, bool update) const
+    {
+        return ExecuteCommand(GenerateArchiveCommand(target, objects, update));
+    }
+
+    // File importers link against for a shared library target, the library itself or its import library
+    virtual fs::path SharedLibraryLinkPath(const Target& target) const
+    {
+        HARMONY_IGNORE(target)
+        Error("SharedLibraryLinkPath is not implemented");
+    }
+
+    // Hash of the symbols exported by a linked shared library, 0 if they can't be determined
+    virtual uint64_t HashExportedInterface(const fs::path& library) const
+    {
+        HARMONY_IGNORE(library)
+        return 0;
+    }
+
+    virtual bool LinkStep(Target& target, std::span<const Task> tasks) const
+    {
+        ForEachObject(*this, target, tasks, [&](const fs::path& obj) {
+            if (!fs::exists(obj)) {
+                LogWarn("Could not find obj [{}]", obj.string());
+            }
+        });
+
+        auto command = GenerateLinkCommand(target, tasks);
+        auto& built_path = target.executable ? target.executable->built_path : target.shared_library.value().built_path;
+        built_path = command.outputs.front();
+        return ExecuteCommand(command);
+    }
 
     virtual void AddSystemIncludeDirs(BuildState& state) const
     {
@@ -60,3 +242,14 @@ struct Backend {
 
 inline
 Backend::~Backend() = default;
+
+// The precompiled header generated for a task's global module fragment, if any
+inline
+const Task* FindPrecompiledHeader(const Task& task, std::span<const Task> tasks)
+{
+    for (auto& depends_on : task.depends_on) {
+        auto& source = tasks[depends_on.source];
+        if (source.kind == TaskKind::PrecompiledHeader) return &source;
+    }
+    return nullptr;
+}
@@ -0,0 +1,348 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "clang-backend.hpp"
+#include "gnu-common.hpp"
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_set>
+#endif
+
+static constexpr std::string_view ClangCppFlags[] = { "-std=c++23", "-stdlib=libc++", "-Wno-reserved-module-identifier" };
+
+static
+SourceType TaskSourceType(const Task& task)
+{
+    return (task.inputs->type == SourceType::Unknown) ? task.source.type : task.inputs->type;
+}
+
+// C++ standard and library flags, clang rejects C++ standards for C sources
+static
+void AddLanguageFlags(Command& command, SourceType type)
+{
+    if (type == SourceType::CSource) return;
+    for (auto flag : ClangCppFlags) command.Add(flag);
+}
+
+ClangBackend::ClangBackend()
+{
+    // TODO: These should be in profile configuration
+    auto clang_env = std::getenv("HARMONY_CLANG");
+    clang = clang_env ? clang_env : "clang++";
+    auto scan_deps_env = std::getenv("HARMONY_CLANG_SCAN_DEPS");
+    clang_scan_deps = scan_deps_env ? scan_deps_env : "clang-scan-deps";
+}
+
+ClangBackend::~ClangBackend() = default;
+
+void ClangBackend::FindDependencies(const Task& task, std::string& dependency_info_p1689_json) const
+{
+    auto output_location = HarmonyTempDir / std::format("{}.p1689.json", task.unique_name);
+
+    Command command{ .working_dir = HarmonyTempDir };
+    command.Add(clang_scan_deps);
+    command.Add("-format=p1689");
+    command.Add("-o");
+    command.AddPath({}, output_location);
+    command.Add("--");
+    auto type = TaskSourceType(task);
+
+    command.Add(clang);
+    AddLanguageFlags(command, type);
+    command.Add("-x");
+    switch (type) {
+        break;case SourceType::CSource: command.Add("c");
+        break;case SourceType::CppSource: command.Add("c++");
+        break;default: command.Add("c++-module");
+    }
+    command.Add("-c");
+    command.AddPath({}, task.source.path);
+    command.Add("-o");
+    command.AddPath({}, HarmonyTempDir / std::format("{}.o", task.unique_name));
+
+    for (auto& include_dir : task.inputs->include_dirs) {
+        command.AddPath("-I", include_dir);
+    }
+
+    for (auto& define : task.inputs->defines) {
+        command.AddFormat("-D{}", define);
+    }
+
+    ExecuteCommand(command);
+    dependency_info_p1689_json = ReadFileToString(output_location);
+}
+
+void ClangBackend::GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const
+{
+    if (!std_task && !std_compat_task) return;
+
+    gnu::GenerateStdModuleTasks(
+        gnu::FindStdModulesManifest(std::format("{} -stdlib=libc++ -print-library-module-manifest-path", clang)),
+        std_task, std_compat_task);
+}
+
+bool ClangBackend::SplitsModuleCompilation() const
+{
+    return true;
+}
+
+bool ClangBackend::SupportsPrecompiledHeaders() const
+{
+    return true;
+}
+
+bool ClangBackend::SupportsSharedLibraries() const
+{
+    return true;
+}
+
+void ClangBackend::AddTaskInfo(std::span<Task> tasks) const
+{
+    for (auto& task : tasks) {
+        auto target_build_dir = HarmonyObjectDir / task.target->name;
+
+        task.obj = target_build_dir / std::format("{}.o", task.unique_name);
+
+        if (task.kind == TaskKind::PrecompiledHeader) {
+            task.bmi = target_build_dir / std::format("{}.pch", task.unique_name);
+        } else if (!task.is_header_unit && !task.produces.empty()) {
+            // Named module BMIs follow clang's naming (partitions use '-') to be found through -fprebuilt-module-path
+            std::string name(NameToString(task.produces.front()));
+            std::ranges::replace(name, ':', '-');
+            task.bmi = target_build_dir / std::format("{}.pcm", name);
+        } else {
+            task.bmi = target_build_dir / std::format("{}.pcm", task.unique_name);
+        }
+    }
+
+    // Codegen reads the BMI written by its interface's precompile task
+    for (auto& task : tasks) {
+        if (task.kind == TaskKind::Codegen) {
+            task.bmi = tasks[task.depends_on.front().source].bmi;
+        }
+    }
+}
+
+Command ClangBackend::GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const
+{
+    Command command{ .working_dir = HarmonyObjectDir / task.target->name };
+
+    auto type = TaskSourceType(task);
+
+    command.Add(clang);
+    // Everything except plain compilation of C sources (BMIs, codegen, precompiled headers, header units) is C++
+    AddLanguageFlags(command, (task.kind == TaskKind::Compile && !task.is_header_unit) ? type : SourceType::CppSource);
+    if (task.target->position_independent) command.Add("-fPIC");
+
+    auto AddLanguage = [&](std::string_view language) {
+        command.Add("-x");
+        command.Add(language);
+    };
+
+    switch (task.kind) {
+        break;case TaskKind::Precompile:
+            AddLanguage("c++-module");
+            command.Add("--precompile");
+            command.AddPath({}, task.source.path);
+            command.Add("-o");
+            command.AddPath({}, task.bmi);
+            command.outputs.emplace_back(task.bmi);
+        break;case TaskKind::PrecompiledHeader:
+            AddLanguage("c++-header");
+            command.AddPath({}, task.source.path);
+            command.Add("-o");
+            command.AddPath({}, task.bmi);
+            command.outputs.emplace_back(task.bmi);
+        break;case TaskKind::Codegen:
+            command.Add("-c");
+            command.AddPath({}, task.bmi);
+            command.Add("-o");
+            command.AddPath({}, task.obj);
+            command.outputs.emplace_back(task.obj);
+        break;case TaskKind::Compile:
+            if (task.is_header_unit) {
+                command.Add("-fmodule-header");
+                AddLanguage("c++-header");
+                command.AddPath({}, task.source.path);
+                command.Add("-o");
+                command.AddPath({}, task.bmi);
+                command.outputs.emplace_back(task.bmi);
+                break;
+            }
+            switch (type) {
+                break;case SourceType::CSource: AddLanguage("c");
+                break;case SourceType::CppSource: AddLanguage("c++");
+                break;case SourceType::CppInterface: AddLanguage("c++-module");
+                break;case SourceType::CppHeader: Error("Attempted to compile header that isn't being exported as a header unit");
+                break;default: Error("Cannot compile: unknown source type!");
+            }
+            command.Add("-c");
+            command.AddPath({}, task.source.path);
+            command.Add("-o");
+            command.AddPath({}, task.obj);
+            command.outputs.emplace_back(task.obj);
+    }
+
+    for (auto& include_dir : task.inputs->include_dirs) {
+        command.AddPath("-I", include_dir);
+    }
+
+    for (auto& define : task.inputs->defines) {
+        command.AddFormat("-D{}", define);
+    }
+
+    if (task.kind != TaskKind::Codegen) {
+        if (auto* pch = FindPrecompiledHeader(task, tasks)) {
+            command.Add("-include-pch");
+            command.AddPath({}, pch->bmi);
+        }
+    }
+
+    // Codegen depends only on its own interface, module references come from the interface's dependencies
+    auto* deps_task = &task;
+    if (task.kind == TaskKind::Codegen) {
+        deps_task = &tasks[task.depends_on.front().source];
+    }
+
+    // Named modules are found by search path, one per referenced target instead of one flag per module
+    std::vector<const Target*> module_targets;
+    for (auto reference : deps_task->references) {
+        auto& source = tasks[reference];
+        if (source.kind == TaskKind::PrecompiledHeader) {
+            continue;
+        } else if (source.is_header_unit) {
+            command.AddPath("-fmodule-file=", source.bmi);
+        } else if (!std::ranges::contains(module_targets, source.target)) {
+            module_targets.emplace_back(source.target);
+            command.AddPath("-fprebuilt-module-path=", source.bmi.parent_path());
+        }
+    }
+
+    return command;
+}
+
+uint32_t ClangBackend::MaxCompileBatchSize() const
+{
+    return 32;
+}
+
+std::vector<bool> ClangBackend::CompileTaskBatch(std::span<const uint32_t> batch, std::span<const Task> tasks) const
+{
+    auto& first = tasks[batch.front()];
+
+    // With multiple inputs, objects are written to the working directory named after their source
+    std::unordered_set<std::string> stems;
+    for (auto index : batch) {
+        if (!stems.emplace(tasks[index].source.path.stem().string()).second) {
+            return Backend::CompileTaskBatch(batch, tasks);
+        }
+    }
+
+    Command command{ .working_dir = HarmonyObjectDir / first.target->name / "batch" / first.unique_name };
+
+    auto type = TaskSourceType(first);
+
+    command.Add(clang);
+    AddLanguageFlags(command, type);
+    if (first.target->position_independent) command.Add("-fPIC");
+
+    command.Add("-x");
+    command.Add(type == SourceType::CSource ? "c" : "c++");
+    command.Add("-c");
+    for (auto index : batch) {
+        auto& task = tasks[index];
+        command.AddPath({}, task.source.path);
+        command.outputs.emplace_back(command.working_dir / std::format("{}.o", task.source.path.stem().string()));
+    }
+
+    for (auto& include_dir : first.inputs->include_dirs) {
+        command.AddPath("-I", include_dir);
+    }
+
+    for (auto& define : first.inputs->defines) {
+        command.AddFormat("-D{}", define);
+    }
+
+    if (!ExecuteCommand(command)) {
+        LogWarn("Batch of {} sources failed, compiling individually to attribute errors", batch.size());
+        return Backend::CompileTaskBatch(batch, tasks);
+    }
+
+    std::vector<bool> results;
+    for (uint32_t i = 0; i < batch.size(); ++i) {
+        std::error_code ec;
+        fs::rename(command.outputs[i], tasks[batch[i]].obj, ec);
+        if (ec) LogError("Could not move [{}] to [{}]: {}", command.outputs[i].string(), tasks[batch[i]].obj.string(), ec.message());
+        results.emplace_back(!ec);
+    }
+    return results;
+}
+
+fs::path ClangBackend::ArchivePath(const Target& target) const
+{
+    return gnu::ArchivePath(target);
+}
+
+Command ClangBackend::GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const
+{
+    HARMONY_IGNORE(update)
+    return gnu::GenerateArchiveCommand(target, objects);
+}
+
+fs::path ClangBackend::SharedLibraryLinkPath(const Target& target) const
+{
+    return gnu::SharedLibraryPath(target);
+}
+
+uint64_t ClangBackend::HashExportedInterface(const fs::path& library) const
+{
+    return gnu::HashExportedInterface(library);
+}
+
+HeaderDependencyFormat ClangBackend::AddHeaderDependencyFlags(Command& command) const
+{
+    return gnu::AddHeaderDependencyFlags(command);
+}
+
+Command ClangBackend::GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const
+{
+    auto output_file = target.shared_library
+        ? gnu::SharedLibraryPath(target)
+        : HarmonyObjectDir / target.name / target.executable.value().name;
+
+    Command command{ .working_dir = output_file.parent_path(), .outputs = { output_file } };
+
+    command.Add(clang);
+    command.Add("-stdlib=libc++");
+    if (target.shared_library) command.Add("-shared");
+    command.Add("-o");
+    command.AddPath({}, output_file);
+    // Shared libraries are copied next to their importers
+    command.Add("-Wl,-rpath,$ORIGIN");
+
+    ForEachObject(*this, target, tasks, [&](auto& obj) {
+        command.AddPath({}, obj);
+    });
+
+    // Libraries may depend on each other in any order
+    command.Add("-Wl,--start-group");
+    ForEachImportedLibrary(*this, target, tasks, [&](auto&, auto& library) {
+        command.AddPath({}, library);
+    });
+    command.Add("-Wl,--end-group");
+
+    ForEachLink(target, [&](auto& link) {
+        command.AddPath({}, link);
+    });
+
+    return command;
+}
+
+void ClangBackend::AddSystemIncludeDirs(BuildState& state) const
+{
+    gnu::AddSystemIncludeDirs(state, std::format("{} -stdlib=libc++", clang));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <backend/backend.hpp>
+
+// Native clang++ backend using libc++. Module interfaces are compiled in two steps, --precompile to the BMI followed
+// by codegen from the BMI, so that importers only wait on the (faster) first step
+struct ClangBackend : Backend
+{
+    std::string clang;
+    std::string clang_scan_deps;
+
+    ClangBackend();
+    ~ClangBackend() final;
+
+    void FindDependencies(const Task& task, std::string& dependency_info_p1689_json) const final;
+    void GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const final;
+    bool SplitsModuleCompilation() const final;
+    bool SupportsPrecompiledHeaders() const final;
+    bool SupportsSharedLibraries() const final;
+    void AddTaskInfo(std::span<Task> tasks) const final;
+    Command GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const final;
+    uint32_t MaxCompileBatchSize() const final;
+    std::vector<bool> CompileTaskBatch(std::span<const uint32_t> batch, std::span<const Task> tasks) const final;
+    fs::path ArchivePath(const Target& target) const final;
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const final;
+    fs::path SharedLibraryLinkPath(const Target& target) const final;
+    uint64_t HashExportedInterface(const fs::path& library) const final;
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command) const final;
+    Command GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const final;
+    void AddSystemIncludeDirs(BuildState& state) const final;
+};
@@ -1,6 +1,3 @@
-// TODO: Abstract json writing
-#include <yyjson.h>
-
 #ifdef HARMONY_USE_IMPORT_STD
 import std;
 import std.compat;
@@ -14,7 +11,6 @@ import std.compat;
 #include <filesystem>
 #include <print>
 #include <fstream>
-#include <unordered_set>
 #endif
 
 // TODO: These should be configurable at runtime
@@ -71,146 +67,95 @@ void ClangClBackend::AddTaskInfo(std::span<Task> tasks) const
     }
 }
 
-bool ClangClBackend::CompileTask(const Task& task) const
+Command ClangClBackend::GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const
 {
     auto build_dir = HarmonyObjectDir;
 
-    auto cmd = std::format("cd /d {} && {}", msvc::PathToCmdString(build_dir), ClangClPath);
-
-    std::vector<std::string> cmds;
+    Command command{ .working_dir = build_dir };
 
-    cmds.emplace_back(std::format("/c /nologo -Wno-everything /EHsc"));
+    command.Add(ClangClPath);
+    for (auto arg : { "/c", "/nologo", "-Wno-everything", "/EHsc" }) command.Add(arg);
     switch (task.source.type) {
-        break;case SourceType::CSource: cmds.emplace_back(std::format("-x c {}", msvc::PathToCmdString(task.source.path)));
-        break;case SourceType::CppSource: cmds.emplace_back(std::format("/std:c++latest -x c++ {}", msvc::PathToCmdString(task.source.path)));
+        break;case SourceType::CSource:
+            for (auto arg : { "-x", "c" }) command.Add(arg);
+        break;case SourceType::CppSource:
+            for (auto arg : { "/std:c++latest", "-x", "c++" }) command.Add(arg);
         break;case SourceType::CppHeader: {
             if (task.is_header_unit) {
-                cmds.emplace_back(std::format("/std:c++latest -fmodule-header -x c++-header {}", msvc::PathToCmdString(task.source.path)));
+                for (auto arg : { "/std:c++latest", "-fmodule-header", "-x", "c++-header" }) command.Add(arg);
             } else Error("Attempted to compile header that isn't being exported as a header unit");
         }
-        break;case SourceType::CppInterface: cmds.emplace_back(std::format("/std:c++latest -x c++-module {}", msvc::PathToCmdString(task.source.path)));
+        break;case SourceType::CppInterface:
+            for (auto arg : { "/std:c++latest", "-x", "c++-module" }) command.Add(arg);
         break;default: Error("Cannot compile: unknown source type!");
     }
+    command.AddPath({}, task.source.path, PathFormatOptions::Backward);
 
-    cmds.emplace_back("-MD");
+    command.Add("-MD");
 
     // cmd += " /Zc:preprocessor /utf-8 /DUNICODE /D_UNICODE /permissive- /Zc:__cplusplus";
-    // cmds.emplace_back("/Zc:preprocessor /permissive-");
-    // cmds.emplace_back("/DWIN32 /D_WINDOWS /EHsc /Ob0 /Od /RTC1 /std:c++latest -MD");
+    // command.Add("/Zc:preprocessor"); command.Add("/permissive-");
+    // command.Add("/DWIN32"); command.Add("/D_WINDOWS"); command.Add("/Ob0"); command.Add("/Od"); command.Add("/RTC1");
 
     for (auto& include_dir : task.inputs->include_dirs) {
-        cmds.emplace_back(std::format("/I{}", msvc::PathToCmdString(include_dir)));
+        command.AddPath("/I", include_dir, PathFormatOptions::Backward);
     }
 
     for (auto& define : task.inputs->defines) {
-        cmds.emplace_back(std::format("/D{}", define));
+        command.AddFormat("/D{}", define);
     }
 
-    // TODO: FIXME - Should this be handled by shared build logic?
-    std::unordered_set<std::string_view> seen;
-    auto AddDependencies = [&cmds, &seen](this auto&& self, const Task& task) -> void {
-        for (auto& depends_on : task.depends_on) {
-
-            if (seen.contains(depends_on.name)) continue;
-            seen.emplace(depends_on.name);
-
-            if (depends_on.source->is_header_unit) {
-                cmds.emplace_back(std::format("-fmodule-file={}", msvc::PathToCmdString(depends_on.source->source.path), msvc::PathToCmdString(depends_on.source->bmi)));
-            } else {
-                cmds.emplace_back(std::format("-fmodule-file={}={}", depends_on.name, msvc::PathToCmdString(depends_on.source->bmi)));
-            }
-            self(*depends_on.source);
+    for (auto reference : task.references) {
+        auto& source = tasks[reference];
+        if (source.is_header_unit) {
+            command.AddPath("-fmodule-file=", source.bmi, PathFormatOptions::Backward);
+        } else {
+            command.AddFormat("-fmodule-file={}={}", source.produces.front(), msvc::PathToArg(source.bmi));
         }
-    };
-
-    AddDependencies(task);
+    }
 
     if (task.source.type == SourceType::CppInterface || task.is_header_unit) {
-        cmds.emplace_back(std::format("-fmodule-output={}", task.bmi.filename().string()));
+        command.AddFormat("-fmodule-output={}", task.bmi.filename().string());
     }
     if (!task.is_header_unit) {
-        cmds.emplace_back(std::format("-o {}", task.obj.filename().string()));
+        command.Add("-o");
+        command.Add(task.obj.filename().string());
     }
 
-    // Generate cmd string, use command files to avoid cmd line size limit
-
-    msvc::SafeCompleteCmd(cmd, cmds);
-
-    LogCmd(cmd);
-
-    return std::system(cmd.c_str()) == 0;
+    if (!task.is_header_unit) {
+        command.outputs.emplace_back(task.obj);
+    }
+    if (task.source.type == SourceType::CppInterface || task.is_header_unit) {
+        command.outputs.emplace_back(task.bmi);
+    }
+    return command;
 }
 
-void ClangClBackend::GenerateCompileCommands(std::span<const Task> tasks) const
+bool ClangClBackend::LinksObject(const Task& task) const
 {
-    auto build_dir = HarmonyObjectDir;
-
-    auto doc = yyjson_mut_doc_new(nullptr);
-
-    auto root = yyjson_mut_arr(doc);
-    yyjson_mut_doc_set_root(doc, root);
-
-    for (auto& task : tasks) {
-        auto out_task = yyjson_mut_arr_add_obj(doc, root);
-
-        // Deduplicate
-        auto cmd = std::format("{}", ClangClPath);
-
-        std::vector<std::string> cmds;
-
-        cmds.emplace_back(std::format("/c /nologo -Wno-everything /EHsc"));
-        switch (task.source.type) {
-            break;case SourceType::CSource: cmds.emplace_back(std::format("-x c {}", msvc::PathToCmdString(task.source.path)));
-            break;case SourceType::CppSource: cmds.emplace_back(std::format("/std:c++latest -x c++ {}", msvc::PathToCmdString(task.source.path)));
-            break;case SourceType::CppHeader: {
-                if (task.is_header_unit) {
-                    cmds.emplace_back(std::format("/std:c++latest -fmodule-header -x c++-header {}", msvc::PathToCmdString(task.source.path)));
-                } else Error("Attempted to compile header that isn't being exported as a header unit");
-            }
-            break;case SourceType::CppInterface: cmds.emplace_back(std::format("/std:c++latest -x c++-module {}", msvc::PathToCmdString(task.source.path)));
-            break;default: Error("Cannot compile: unknown source type!");
-        }
-
-        // cmd += " /Zc:preprocessor /utf-8 /DUNICODE /D_UNICODE /permissive- /Zc:__cplusplus";
-        // cmds.emplace_back("/Zc:preprocessor /permissive-");
-        // cmds.emplace_back("/DWIN32 /D_WINDOWS /EHsc /Ob0 /Od /RTC1 /std:c++latest -MD");
-
-        for (auto& include_dir : task.inputs->include_dirs) {
-            cmds.emplace_back(std::format("/I{}", msvc::PathToCmdString(include_dir)));
-        }
-
-        for (auto& define : task.inputs->defines) {
-            cmds.emplace_back(std::format("/D{}", define));
-        }
-
-        if (task.source.type == SourceType::CppInterface || task.is_header_unit) {
-            cmds.emplace_back(std::format("-fmodule-output={}", task.bmi.filename().string()));
-        }
-        if (!task.is_header_unit) {
-            cmds.emplace_back(std::format("-o {}", task.obj.filename().string()));
-        }
+    // Header units have objects as well
+    HARMONY_IGNORE(task)
+    return true;
+}
 
-        msvc::SafeCompleteCmd(cmd, cmds);
+fs::path ClangClBackend::ArchivePath(const Target& target) const
+{
+    return msvc::ArchivePath(target);
+}
 
-        yyjson_mut_obj_add_strcpy(doc, out_task, "directory", fs::absolute(build_dir).string().c_str());
-        yyjson_mut_obj_add_strcpy(doc, out_task, "command", cmd.c_str());
-        yyjson_mut_obj_add_strcpy(doc, out_task, "file", fs::absolute(task.source.path).string().c_str());
-        yyjson_mut_obj_add_strcpy(doc, out_task, "output", fs::absolute(task.obj).string().c_str());
-    }
+Command ClangClBackend::GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const
+{
+    return msvc::GenerateArchiveCommand(target, objects, update);
+}
 
-    {
-        yyjson_write_flag flags = YYJSON_WRITE_PRETTY | YYJSON_WRITE_ESCAPE_UNICODE;
-        yyjson_write_err err;
-        yyjson_mut_write_file("compile_commands.json", doc, flags, nullptr, &err);
-        if (err.code) {
-            std::println("JSON write error ({}): {}", err.code, err.msg);
-        }
-    }
+HeaderDependencyFormat ClangClBackend::AddHeaderDependencyFlags(Command& command) const
+{
+    return msvc::AddHeaderDependencyFlags(command);
 }
 
-bool ClangClBackend::LinkStep(Target& target, std::span<const Task> tasks) const
+Command ClangClBackend::GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const
 {
-    return msvc::LinkStep(target, tasks);
+    return msvc::GenerateLinkCommand(*this, target, tasks);
 }
 
 void ClangClBackend::AddSystemIncludeDirs(BuildState& state) const
@@ -12,8 +12,11 @@ struct ClangClBackend : Backend
     void FindDependencies(const Task& task, std::string& dependency_info_p1689_json) const final;
     void GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const final;
     void AddTaskInfo(std::span<Task> tasks) const final;
-    bool CompileTask(const Task& task) const final;
-    void GenerateCompileCommands(std::span<const Task> tasks) const final;
-    bool LinkStep(Target& target, std::span<const Task> tasks) const final;
+    Command GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const final;
+    bool LinksObject(const Task& task) const final;
+    fs::path ArchivePath(const Target& target) const final;
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const final;
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command) const final;
+    Command GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const final;
     void AddSystemIncludeDirs(BuildState& state) const final;
 };
@@ -0,0 +1,271 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "fake-backend.hpp"
+
+#include <xxhash.h>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <thread>
+#endif
+
+static const fs::path FakeStdModulesDir = HarmonyTempDir / "fake-std";
+
+FakeBackend::FakeBackend() = default;
+
+FakeBackend::~FakeBackend() = default;
+
+void FakeBackend::LoadReplay(const fs::path& build_log)
+{
+    if (!fs::exists(build_log)) {
+        Error("Replay build log [{}] not found", build_log.string());
+    }
+
+    BuildLog log;
+    log.Load(build_log);
+    for (auto&[key, entry] : log.entries) {
+        replay[key] = entry.usage.wall;
+    }
+
+    LogInfo("Replaying {} recorded durations from [{}]", replay.size(), build_log.string());
+}
+
+chr::nanoseconds FakeBackend::SimulatedDuration(const std::string& key) const
+{
+    auto iter = replay.find(key);
+    return iter == replay.end() ? duration : iter->second;
+}
+
+void FakeBackend::Simulate(chr::nanoseconds wall) const
+{
+    if (wall.count()) {
+        std::this_thread::sleep_for(wall);
+    }
+
+    // Report the simulated time as if a process had run, so build logs and estimates behave as for real builds
+    ResourceAccountingScope::Record({ .wall = wall, .processes = 1 });
+}
+
+void FakeBackend::GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const
+{
+    // Placeholder sources so that up-to-date checks have something to compare against
+
+    fs::create_directories(FakeStdModulesDir);
+
+    if (std_task) {
+        std_task->source.path = FakeStdModulesDir / "std.ixx";
+        WriteFileIfChanged(std_task->source.path, "export module std;\n");
+    }
+
+    if (std_compat_task) {
+        std_compat_task->source.path = FakeStdModulesDir / "std.compat.ixx";
+        WriteFileIfChanged(std_compat_task->source.path, "export module std.compat;\nexport import std;\n");
+    }
+}
+
+bool FakeBackend::SupportsPrecompiledHeaders() const
+{
+    return true;
+}
+
+bool FakeBackend::SupportsIncludeTranslation() const
+{
+    return true;
+}
+
+bool FakeBackend::SupportsSharedLibraries() const
+{
+    return true;
+}
+
+void FakeBackend::AddTaskInfo(std::span<Task> tasks) const
+{
+    for (auto& task : tasks) {
+        auto target_build_dir = out_dir / task.target->name;
+
+        task.obj = target_build_dir / std::format("{}.o", task.unique_name);
+        task.bmi = target_build_dir / std::format("{}.bmi", task.unique_name);
+    }
+}
+
+Command FakeBackend::GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const
+{
+    if (task.kind == TaskKind::PrecompiledHeader) {
+        Command command{ .working_dir = out_dir / task.target->name, .outputs = { task.bmi } };
+        command.Add("fake-cc");
+        command.Add("-pch");
+        command.AddPath({}, task.source.path);
+        command.Add("-o");
+        command.AddPath({}, task.bmi);
+        return command;
+    }
+
+    Command command{ .working_dir = out_dir / task.target->name, .outputs = { task.obj } };
+    command.Add("fake-cc");
+    command.AddPath({}, task.source.path);
+    command.Add("-o");
+    command.AddPath({}, task.obj);
+    if (task.is_header_unit || !task.produces.empty()) {
+        command.outputs.emplace_back(task.bmi);
+        command.Add("-bmi");
+        command.AddPath({}, task.bmi);
+    }
+    if (task.translate_includes) {
+        command.Add("-translate-includes");
+    }
+    if (auto* pch = FindPrecompiledHeader(task, tasks)) {
+        command.Add("-include-pch");
+        command.AddPath({}, pch->bmi);
+    }
+    return command;
+}
+
+bool FakeBackend::CompileTask(const Task& task, std::span<const Task> tasks) const
+{
+    auto command = GenerateCompileCommand(task, tasks);
+    if (TraceCmds) LogCmd(command.ToString());
+
+    Simulate(SimulatedDuration(BuildLogKey(task)));
+
+    auto source = task.source.path.generic_string();
+    for (auto& pattern : fail_patterns) {
+        if (source.contains(pattern)) {
+            LogError("[fake] Failing [{}] (matches [{}])", task.unique_name, pattern);
+            return false;
+        }
+    }
+
+    fs::create_directories(command.working_dir);
+    for (auto& output : command.outputs) {
+        WriteStringToFile(output, task.unique_name);
+    }
+
+    return true;
+}
+
+uint32_t FakeBackend::MaxCompileBatchSize() const
+{
+    return 16;
+}
+
+std::vector<bool> FakeBackend::CompileTaskBatch(std::span<const uint32_t> batch, std::span<const Task> tasks) const
+{
+    // A failing member fails the whole invocation, which is then retried per task like a real backend would
+    for (auto index : batch) {
+        auto source = tasks[index].source.path.generic_string();
+        if (std::ranges::any_of(fail_patterns, [&](auto& pattern) { return source.contains(pattern); })) {
+            return Backend::CompileTaskBatch(batch, tasks);
+        }
+    }
+
+    // The whole batch is simulated as a single invocation
+    chr::nanoseconds wall{};
+    for (auto index : batch) wall += SimulatedDuration(BuildLogKey(tasks[index]));
+    Simulate(wall);
+
+    std::vector<bool> results;
+    for (auto index : batch) {
+        auto& task = tasks[index];
+        auto command = GenerateCompileCommand(task, tasks);
+        if (TraceCmds) LogCmd(command.ToString());
+
+        fs::create_directories(command.working_dir);
+        for (auto& output : command.outputs) {
+            WriteStringToFile(output, task.unique_name);
+        }
+        results.emplace_back(true);
+    }
+    return results;
+}
+
+fs::path FakeBackend::ArchivePath(const Target& target) const
+{
+    return out_dir / target.name / std::format("lib{}.a", target.name);
+}
+
+Command FakeBackend::GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const
+{
+    auto archive = ArchivePath(target);
+
+    Command command{ .working_dir = archive.parent_path(), .outputs = { archive } };
+    command.Add("fake-ar");
+    if (update) command.Add("-update");
+    command.AddPath({}, archive);
+    for (auto& object : objects) {
+        command.AddPath({}, object);
+    }
+    return command;
+}
+
+bool FakeBackend::ArchiveStep(const Target& target, std::span<const fs::path> objects, bool update) const
+{
+    auto command = GenerateArchiveCommand(target, objects, update);
+    if (TraceCmds) LogCmd(command.ToString());
+
+    Simulate(SimulatedDuration(BuildLogArchiveKey(target)));
+
+    fs::create_directories(command.working_dir);
+    WriteStringToFile(command.outputs.front(), target.name);
+
+    return true;
+}
+
+fs::path FakeBackend::SharedLibraryLinkPath(const Target& target) const
+{
+    return out_dir / target.name / std::format("lib{}.so", target.shared_library.value().name);
+}
+
+uint64_t FakeBackend::HashExportedInterface(const fs::path& library) const
+{
+    // Fake libraries only contain their target name, so their interface never changes
+    auto contents = ReadFileToString(library);
+    auto hash = XXH64(contents.data(), contents.size(), 0);
+    return hash ? hash : 1;
+}
+
+Command FakeBackend::GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const
+{
+    auto output = target.shared_library ? SharedLibraryLinkPath(target) : out_dir / target.name / target.executable->name;
+
+    Command command{ .working_dir = output.parent_path(), .outputs = { output } };
+    command.Add("fake-ld");
+    if (target.shared_library) command.Add("-shared");
+    ForEachObject(*this, target, tasks, [&](auto& obj) {
+        command.AddPath({}, obj);
+    });
+    ForEachImportedLibrary(*this, target, tasks, [&](auto&, auto& library) {
+        command.AddPath({}, library);
+    });
+    command.Add("-o");
+    command.AddPath({}, output);
+    return command;
+}
+
+bool FakeBackend::LinkStep(Target& target, std::span<const Task> tasks) const
+{
+    auto command = GenerateLinkCommand(target, tasks);
+    if (TraceCmds) LogCmd(command.ToString());
+
+    Simulate(SimulatedDuration(BuildLogKey(target)));
+
+    for (auto& pattern : fail_patterns) {
+        if (target.name.contains(pattern)) {
+            LogError("[fake] Failing link of [{}] (matches [{}])", target.name, pattern);
+            return false;
+        }
+    }
+
+    fs::create_directories(command.working_dir);
+    WriteStringToFile(command.outputs.front(), target.name);
+    auto& built_path = target.executable ? target.executable->built_path : target.shared_library.value().built_path;
+    built_path = command.outputs.front();
+
+    return true;
+}
+
+void FakeBackend::AddSystemIncludeDirs(BuildState& state) const
+{
+    HARMONY_IGNORE(state)
+}
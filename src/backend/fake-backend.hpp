@@ -0,0 +1,47 @@
+#pragma once
+
+#include <backend/backend.hpp>
+
+// Backend that doesn't invoke a compiler. Tasks write placeholder outputs after sleeping for a fixed or replayed
+// duration, and can be made to fail on demand. Used to exercise the scheduler, caching and incremental logic
+struct FakeBackend : Backend
+{
+    fs::path out_dir = HarmonyObjectDir;
+
+    // Duration for tasks without replayed timings
+    chr::nanoseconds duration{};
+
+    // Recorded wall times, keyed by BuildLogKey
+    std::unordered_map<std::string, chr::nanoseconds> replay;
+
+    // Tasks with a source path containing any of these fail
+    std::vector<std::string> fail_patterns;
+
+    FakeBackend();
+    ~FakeBackend() final;
+
+    // Replay task durations from a build log written by a previous (real) build
+    void LoadReplay(const fs::path& build_log);
+
+    void GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const final;
+    bool SupportsPrecompiledHeaders() const final;
+    bool SupportsIncludeTranslation() const final;
+    bool SupportsSharedLibraries() const final;
+    void AddTaskInfo(std::span<Task> tasks) const final;
+    Command GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const final;
+    bool CompileTask(const Task& task, std::span<const Task> tasks) const final;
+    uint32_t MaxCompileBatchSize() const final;
+    std::vector<bool> CompileTaskBatch(std::span<const uint32_t> batch, std::span<const Task> tasks) const final;
+    fs::path ArchivePath(const Target& target) const final;
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const final;
+    bool ArchiveStep(const Target& target, std::span<const fs::path> objects, bool update) const final;
+    fs::path SharedLibraryLinkPath(const Target& target) const final;
+    uint64_t HashExportedInterface(const fs::path& library) const final;
+    Command GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const final;
+    bool LinkStep(Target& target, std::span<const Task> tasks) const final;
+    void AddSystemIncludeDirs(BuildState& state) const final;
+
+private:
+    chr::nanoseconds SimulatedDuration(const std::string& key) const;
+    void Simulate(chr::nanoseconds wall) const;
+};
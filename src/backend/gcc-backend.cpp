@@ -0,0 +1,472 @@
+// read/write
+#include <unistd.h>
+#include <cerrno>
+
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "gcc-backend.hpp"
+#include "gnu-common.hpp"
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <cctype>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+#endif
+
+static constexpr std::string_view GccCppFlags[] = { "-std=c++23", "-fmodules" };
+
+static
+SourceType TaskSourceType(const Task& task)
+{
+    return (task.inputs->type == SourceType::Unknown) ? task.source.type : task.inputs->type;
+}
+
+GccBackend::GccBackend()
+{
+    // TODO: This should be in profile configuration
+    auto gcc_env = std::getenv("HARMONY_GCC");
+    gcc = gcc_env ? gcc_env : "g++";
+}
+
+GccBackend::~GccBackend() = default;
+
+void GccBackend::FindDependencies(const Task& task, std::string& dependency_info_p1689_json) const
+{
+    // C has no modules, and g++ only writes dependency information for C++
+    if (TaskSourceType(task) == SourceType::CSource) {
+        dependency_info_p1689_json = R"({ "version": 1, "revision": 0, "rules": [] })";
+        return;
+    }
+
+    auto output_location = HarmonyTempDir / std::format("{}.p1689.json", task.unique_name);
+
+    Command command{ .working_dir = HarmonyTempDir };
+    command.Add(gcc);
+    for (auto flag : GccCppFlags) command.Add(flag);
+    command.Add("-E");
+    command.Add("-x");
+    command.Add("c++");
+    command.AddPath({}, task.source.path);
+    command.Add("-fdeps-format=p1689r5");
+    command.AddPath("-fdeps-file=", output_location);
+    command.AddPath("-fdeps-target=", HarmonyTempDir / std::format("{}.o", task.unique_name));
+    command.Add("-MD");
+    command.Add("-MF");
+    command.AddPath({}, HarmonyTempDir / std::format("{}.d", task.unique_name));
+    command.Add("-o");
+    command.AddPath({}, HarmonyTempDir / std::format("{}.i", task.unique_name));
+
+    for (auto& include_dir : task.inputs->include_dirs) {
+        command.AddPath("-I", include_dir);
+    }
+
+    for (auto& define : task.inputs->defines) {
+        command.AddFormat("-D{}", define);
+    }
+
+    ExecuteCommand(command);
+    dependency_info_p1689_json = ReadFileToString(output_location);
+}
+
+void GccBackend::GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const
+{
+    if (!std_task && !std_compat_task) return;
+
+    gnu::GenerateStdModuleTasks(
+        gnu::FindStdModulesManifest(std::format("{} -print-file-name=libstdc++.modules.json", gcc)),
+        std_task, std_compat_task);
+}
+
+bool GccBackend::SupportsIncludeTranslation() const
+{
+    return true;
+}
+
+bool GccBackend::SupportsSharedLibraries() const
+{
+    return true;
+}
+
+void GccBackend::AddTaskInfo(std::span<Task> tasks) const
+{
+    for (auto& task : tasks) {
+        auto target_build_dir = HarmonyObjectDir / task.target->name;
+
+        task.obj = target_build_dir / std::format("{}.o", task.unique_name);
+        task.bmi = target_build_dir / std::format("{}.gcm", task.unique_name);
+    }
+}
+
+Command GccBackend::GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const
+{
+    HARMONY_IGNORE(tasks)
+
+    Command command{ .working_dir = HarmonyObjectDir / task.target->name };
+
+    auto type = TaskSourceType(task);
+
+    command.Add(gcc);
+    // C++ standard and module flags don't apply to C sources
+    if (task.is_header_unit || type != SourceType::CSource) {
+        for (auto flag : GccCppFlags) command.Add(flag);
+    }
+    if (task.target->position_independent) command.Add("-fPIC");
+
+    auto AddLanguage = [&](std::string_view language) {
+        command.Add("-x");
+        command.Add(language);
+    };
+
+    if (task.is_header_unit) {
+        // Header units only produce a CMI, its location is provided through the mapper
+        command.Add("-fmodule-header");
+        AddLanguage("c++-header");
+        command.Add("-c");
+        command.AddPath({}, task.source.path);
+        command.outputs.emplace_back(task.bmi);
+    } else {
+        switch (type) {
+            break;case SourceType::CSource: AddLanguage("c");
+            break;case SourceType::CppSource: AddLanguage("c++");
+            break;case SourceType::CppInterface: AddLanguage("c++");
+            break;case SourceType::CppHeader: Error("Attempted to compile header that isn't being exported as a header unit");
+            break;default: Error("Cannot compile: unknown source type!");
+        }
+        command.Add("-c");
+        command.AddPath({}, task.source.path);
+        command.Add("-o");
+        command.AddPath({}, task.obj);
+        command.outputs.emplace_back(task.obj);
+        if (!task.produces.empty()) command.outputs.emplace_back(task.bmi);
+    }
+
+    for (auto& include_dir : task.inputs->include_dirs) {
+        command.AddPath("-I", include_dir);
+    }
+
+    for (auto& define : task.inputs->defines) {
+        command.AddFormat("-D{}", define);
+    }
+
+    return command;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+//  Module mapper, answering the libcody protocol spoken by the compiler
+// ---------------------------------------------------------------------------------------------------------------------
+
+namespace
+{
+    std::vector<std::string> SplitCodyWords(std::string_view line)
+    {
+        std::vector<std::string> words;
+
+        size_t i = 0;
+        while (i < line.size()) {
+            if (line[i] == ' ' || line[i] == '\t') { i++; continue; }
+
+            auto& word = words.emplace_back();
+            while (i < line.size() && line[i] != ' ' && line[i] != '\t') {
+                if (line[i] != '\'') {
+                    word += line[i++];
+                    continue;
+                }
+
+                // Quoted section, with backslash escapes
+                i++;
+                while (i < line.size() && line[i] != '\'') {
+                    if (line[i] != '\\' || i + 1 >= line.size()) {
+                        word += line[i++];
+                        continue;
+                    }
+                    char c = line[i + 1];
+                    i += 2;
+                    switch (c) {
+                        break;case 'n': word += '\n';
+                        break;case 't': word += '\t';
+                        break;case '_': word += ' ';
+                        break;case '\'': case '\\': word += c;
+                        break;default:
+                            // Two hex digits
+                            if (i < line.size()) {
+                                word += char(std::stoi(std::string{ c, line[i] }, nullptr, 16));
+                                i++;
+                            }
+                    }
+                }
+                i++;
+            }
+        }
+
+        return words;
+    }
+
+    std::string CodyWord(std::string_view str)
+    {
+        auto IsPlain = [](char c) {
+            return std::isalnum(uint8_t(c)) || std::string_view("-+_/%.@=,:").contains(c);
+        };
+
+        if (!str.empty() && std::ranges::all_of(str, IsPlain)) return std::string(str);
+
+        std::string word = "'";
+        for (char c : str) {
+            if      (c == '\'') word += "\\'";
+            else if (c == '\\') word += "\\\\";
+            else if (c == '\n') word += "\\n";
+            else if (c == '\t') word += "\\t";
+            else word += c;
+        }
+        word += '\'';
+        return word;
+    }
+
+    bool WriteAll(int fd, std::string_view data)
+    {
+        while (!data.empty()) {
+            auto written = write(fd, data.data(), data.size());
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data.remove_prefix(size_t(written));
+        }
+        return true;
+    }
+
+    struct ModuleMapper
+    {
+        const Task& task;
+        std::span<const Task> tasks;
+        fs::path working_dir;
+
+        // Every BMI the task may legitimately import, the transitive closure of its scanned dependencies
+        std::unordered_map<NameId, uint32_t> modules;
+        std::unordered_map<PathId, uint32_t> header_units;
+
+        std::unordered_set<uint32_t> requested;
+        std::vector<std::string> unexpected;
+
+        ModuleMapper(const Task& _task, std::span<const Task> _tasks, fs::path _working_dir)
+            : task(_task)
+            , tasks(_tasks)
+            , working_dir(std::move(_working_dir))
+        {
+            for (auto reference : task.references) {
+                auto& source = tasks[reference];
+                if (source.is_header_unit) {
+                    header_units.emplace(source.source_id, reference);
+                } else {
+                    modules.emplace(source.produces.front(), reference);
+                }
+            }
+        }
+
+        static
+        bool IsHeaderName(std::string_view name)
+        {
+            return name.starts_with('/') || name.starts_with("./") || name.starts_with("../");
+        }
+
+        std::optional<uint32_t> Resolve(std::string_view name)
+        {
+            if (IsHeaderName(name)) {
+                auto path = fs::path(name);
+                if (path.is_relative()) path = working_dir / path;
+                auto iter = header_units.find(InternPath(path));
+                if (iter != header_units.end()) return iter->second;
+            } else {
+                auto iter = modules.find(InternName(name));
+                if (iter != modules.end()) return iter->second;
+            }
+            return std::nullopt;
+        }
+
+        std::string Respond(std::span<const std::string> words)
+        {
+            if (words.empty()) return "ERROR 'Empty request'";
+            auto& request = words[0];
+
+            if (request == "HELLO") {
+                return "HELLO 1 harmony";
+            }
+
+            if (request == "MODULE-REPO") {
+                return std::format("PATHNAME {}", CodyWord(working_dir.generic_string()));
+            }
+
+            if (words.size() < 2) return std::format("ERROR {}", CodyWord(std::format("Malformed request: {}", request)));
+            auto& name = words[1];
+
+            if (request == "MODULE-EXPORT") {
+                if (task.is_header_unit || std::ranges::contains(task.produces, InternName(name))) {
+                    return std::format("PATHNAME {}", CodyWord(task.bmi.generic_string()));
+                }
+                unexpected.emplace_back(std::format("exports [{}]", name));
+                return std::format("ERROR {}", CodyWord(std::format("[{}] is not produced by this task according to the dependency scan", name)));
+            }
+
+            if (request == "MODULE-IMPORT") {
+                if (auto index = Resolve(name)) {
+                    requested.emplace(*index);
+                    return std::format("PATHNAME {}", CodyWord(tasks[*index].bmi.generic_string()));
+                }
+                unexpected.emplace_back(std::format("imports [{}]", name));
+                return std::format("ERROR {}", CodyWord(std::format("[{}] is not a dependency of this task according to the dependency scan", name)));
+            }
+
+            if (request == "MODULE-COMPILED") {
+                return "OK";
+            }
+
+            if (request == "INCLUDE-TRANSLATE") {
+                if (!task.translate_includes || !IsHeaderName(name)) return "BOOL FALSE";
+                if (auto index = Resolve(name)) {
+                    requested.emplace(*index);
+                    return std::format("PATHNAME {}", CodyWord(tasks[*index].bmi.generic_string()));
+                }
+                return "BOOL FALSE";
+            }
+
+            return std::format("ERROR {}", CodyWord(std::format("Unknown request: {}", request)));
+        }
+
+        void Serve(int read_fd, int write_fd)
+        {
+            // Requests arrive in batches, every line but the last of a batch ends with a ';' word, and responses are
+            // returned in the same form once the batch is complete
+            std::string buffer;
+            std::vector<std::string> responses;
+            char chunk[4096];
+
+            for (;;) {
+                auto count = read(read_fd, chunk, sizeof(chunk));
+                if (count < 0 && errno == EINTR) continue;
+                if (count <= 0) break;
+                buffer.append(chunk, size_t(count));
+
+                size_t begin = 0;
+                for (size_t eol; (eol = buffer.find('\n', begin)) != std::string::npos; begin = eol + 1) {
+                    auto words = SplitCodyWords(std::string_view(buffer).substr(begin, eol - begin));
+                    bool more = !words.empty() && words.back() == ";";
+                    if (more) words.pop_back();
+
+                    responses.emplace_back(Respond(words));
+                    if (more) continue;
+
+                    std::string reply;
+                    for (uint32_t i = 0; i < responses.size(); ++i) {
+                        reply += responses[i];
+                        reply += (i + 1 < responses.size()) ? " ;\n" : "\n";
+                    }
+                    responses.clear();
+
+                    if (!WriteAll(write_fd, reply)) return;
+                }
+                buffer.erase(0, begin);
+            }
+        }
+    };
+}
+
+bool GccBackend::CompileTask(const Task& task, std::span<const Task> tasks) const
+{
+    // C sources can't import modules, so there are no mapper requests to serve
+    if (!task.is_header_unit && TaskSourceType(task) == SourceType::CSource) {
+        return Backend::CompileTask(task, tasks);
+    }
+
+    auto command = GenerateCompileCommand(task, tasks);
+    command.AddFormat("-fmodule-mapper=<{}>{}", ChildChannelReadFd, ChildChannelWriteFd);
+
+    fs::create_directories(command.working_dir);
+    if (TraceCmds) LogCmd(command.ToString());
+
+    ModuleMapper mapper(task, tasks, command.working_dir);
+    std::string response_arg;
+    auto result = RunCommandWithChannel(ExecutionArgs(command, response_arg), command.working_dir, [&](int read_fd, int write_fd) {
+        mapper.Serve(read_fd, write_fd);
+    });
+
+    for (auto& unexpected : mapper.unexpected) {
+        LogError("[{}] {}, which was not found by the dependency scan", task.source.path.string(), unexpected);
+    }
+
+    if (result == 0) {
+        for (auto& depends_on : task.depends_on) {
+            if (!mapper.requested.contains(depends_on.source)) {
+                LogDebug("[{}] never requested scanned dependency [{}]", task.source.path.string(), NameToString(depends_on.name));
+            }
+        }
+    }
+
+    return result == 0 && mapper.unexpected.empty();
+}
+
+fs::path GccBackend::ArchivePath(const Target& target) const
+{
+    return gnu::ArchivePath(target);
+}
+
+Command GccBackend::GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const
+{
+    HARMONY_IGNORE(update)
+    return gnu::GenerateArchiveCommand(target, objects);
+}
+
+fs::path GccBackend::SharedLibraryLinkPath(const Target& target) const
+{
+    return gnu::SharedLibraryPath(target);
+}
+
+uint64_t GccBackend::HashExportedInterface(const fs::path& library) const
+{
+    return gnu::HashExportedInterface(library);
+}
+
+HeaderDependencyFormat GccBackend::AddHeaderDependencyFlags(Command& command) const
+{
+    return gnu::AddHeaderDependencyFlags(command);
+}
+
+Command GccBackend::GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const
+{
+    auto output_file = target.shared_library
+        ? gnu::SharedLibraryPath(target)
+        : HarmonyObjectDir / target.name / target.executable.value().name;
+
+    Command command{ .working_dir = output_file.parent_path(), .outputs = { output_file } };
+
+    command.Add(gcc);
+    if (target.shared_library) command.Add("-shared");
+    command.Add("-o");
+    command.AddPath({}, output_file);
+    // Shared libraries are copied next to their importers
+    command.Add("-Wl,-rpath,$ORIGIN");
+
+    ForEachObject(*this, target, tasks, [&](auto& obj) {
+        command.AddPath({}, obj);
+    });
+
+    // Libraries may depend on each other in any order
+    command.Add("-Wl,--start-group");
+    ForEachImportedLibrary(*this, target, tasks, [&](auto&, auto& library) {
+        command.AddPath({}, library);
+    });
+    command.Add("-Wl,--end-group");
+
+    ForEachLink(target, [&](auto& link) {
+        command.AddPath({}, link);
+    });
+
+    return command;
+}
+
+void GccBackend::AddSystemIncludeDirs(BuildState& state) const
+{
+    gnu::AddSystemIncludeDirs(state, gcc);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <backend/backend.hpp>
+
+// Native g++ backend. Harmony answers the compiler's module mapper requests itself over a pipe pair, resolving module
+// names directly from the task graph instead of through mapper files or CMI repository lookups.
+// Generated commands (compile_commands.json, ninja) do not include the mapper, as it only exists while Harmony runs
+struct GccBackend : Backend
+{
+    std::string gcc;
+
+    GccBackend();
+    ~GccBackend() final;
+
+    void FindDependencies(const Task& task, std::string& dependency_info_p1689_json) const final;
+    void GenerateStdModuleTasks(Task* std_task, Task* std_compat_task) const final;
+    bool SupportsIncludeTranslation() const final;
+    bool SupportsSharedLibraries() const final;
+    void AddTaskInfo(std::span<Task> tasks) const final;
+    Command GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const final;
+    bool CompileTask(const Task& task, std::span<const Task> tasks) const final;
+    fs::path ArchivePath(const Target& target) const final;
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const final;
+    fs::path SharedLibraryLinkPath(const Target& target) const final;
+    uint64_t HashExportedInterface(const fs::path& library) const final;
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command) const final;
+    Command GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const final;
+    void AddSystemIncludeDirs(BuildState& state) const final;
+};
@@ -0,0 +1,138 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "gnu-common.hpp"
+
+#include <json.hpp>
+#include <xxhash.h>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <cctype>
+#include <ranges>
+#endif
+
+static
+std::string_view Trim(std::string_view str)
+{
+    while (!str.empty() && std::isspace(uint8_t(str.front()))) str.remove_prefix(1);
+    while (!str.empty() && std::isspace(uint8_t(str.back()))) str.remove_suffix(1);
+    return str;
+}
+
+namespace gnu
+{
+    void GenerateStdModuleTasks(const fs::path& manifest_path, Task* std_task, Task* std_compat_task)
+    {
+        if (manifest_path.empty() || !fs::exists(manifest_path)) {
+            Error("Standard library modules manifest not found, std modules require a standard library built with module support");
+        }
+
+        LogTrace("Found std modules manifest [{}]", manifest_path.string());
+
+        auto contents = ReadFileToString(manifest_path);
+        JsonDocument doc(contents);
+        for (auto module : doc.root()["modules"]) {
+            auto name = module["logical-name"].string();
+            auto source_path = module["source-path"].string();
+            if (!name || !source_path) continue;
+            auto path = (manifest_path.parent_path() / source_path).lexically_normal();
+            if ("std"sv == name && std_task) std_task->source.path = path;
+            if ("std.compat"sv == name && std_compat_task) std_compat_task->source.path = path;
+        }
+
+        if (std_task && std_task->source.path.empty()) Error("[std] not listed in [{}]", manifest_path.string());
+        if (std_compat_task && std_compat_task->source.path.empty()) Error("[std.compat] not listed in [{}]", manifest_path.string());
+    }
+
+    void AddSystemIncludeDirs(BuildState& state, std::string_view compiler)
+    {
+        // The include search list is reported on stderr between these markers when run with -v
+        auto output = CaptureCommandOutput(std::format("{} -x c++ -E -v - < /dev/null 2>&1 >/dev/null", compiler));
+        if (!output) Error("Failed to query system include directories from [{}]", compiler);
+
+        std::string_view remaining = *output;
+        bool in_search_list = false;
+        while (!remaining.empty()) {
+            auto eol = std::min(remaining.find('\n'), remaining.size());
+            auto line = remaining.substr(0, eol);
+            remaining.remove_prefix(std::min(eol + 1, remaining.size()));
+
+            if (line.starts_with("#include <...> search starts here:")) {
+                in_search_list = true;
+            } else if (line.starts_with("End of search list.")) {
+                break;
+            } else if (in_search_list) {
+                auto include = Trim(line);
+                LogTrace("Found system include dir: [{}]", include);
+                state.system_includes.emplace_back(fs::path(include).lexically_normal());
+            }
+        }
+    }
+
+    fs::path FindStdModulesManifest(const std::string& query)
+    {
+        auto output = CaptureCommandOutput(query);
+        return fs::path(Trim(output.value_or("")));
+    }
+
+    fs::path ArchivePath(const Target& target)
+    {
+        return HarmonyObjectDir / target.name / std::format("lib{}.a", target.name);
+    }
+
+    fs::path SharedLibraryPath(const Target& target)
+    {
+        return HarmonyObjectDir / target.name / std::format("lib{}.so", target.shared_library.value().name);
+    }
+
+    uint64_t HashExportedInterface(const fs::path& library)
+    {
+        // TODO: This should be in profile configuration
+        auto output = CaptureCommandOutput(std::format("nm -D --defined-only --format=posix {}", QuoteArgument(library.string())));
+        if (!output) return 0;
+
+        // Only names and symbol types, addresses and sizes change with any code change
+        std::vector<std::string_view> symbols;
+        for (auto line : std::views::split(std::string_view(*output), '\n')) {
+            std::string_view symbol(line.begin(), line.end());
+            auto name_end = symbol.find(' ');
+            if (name_end == std::string_view::npos || name_end + 2 > symbol.size()) continue;
+            symbols.emplace_back(symbol.substr(0, name_end + 2));
+        }
+        std::ranges::sort(symbols);
+
+        uint64_t hash = 0;
+        for (auto symbol : symbols) {
+            hash = XXH64(symbol.data(), symbol.size(), hash);
+        }
+        // 0 is reserved for an unknown interface
+        return hash ? hash : 1;
+    }
+
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects)
+    {
+        auto archive = ArchivePath(target);
+
+        Command command{ .working_dir = archive.parent_path(), .outputs = { archive } };
+
+        // TODO: This should be in profile configuration
+        command.Add("ar");
+        command.Add("rcsT");
+        command.AddPath({}, archive);
+        for (auto& object : objects) {
+            command.AddPath({}, object);
+        }
+
+        return command;
+    }
+
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command)
+    {
+        command.Add("-MD");
+        command.Add("-MF");
+        command.AddPath({}, fs::path(command.outputs.front()).concat(".d"));
+        return HeaderDependencyFormat::Gcc;
+    }
+}
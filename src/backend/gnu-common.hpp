@@ -0,0 +1,27 @@
+#pragma once
+
+#include <backend/backend.hpp>
+
+namespace gnu
+{
+    // Run a compiler query that prints the path of the standard library modules manifest
+    fs::path FindStdModulesManifest(const std::string& query);
+
+    // Fill std and std.compat sources from a standard library modules manifest (libc++.modules.json,
+    // libstdc++.modules.json)
+    void GenerateStdModuleTasks(const fs::path& manifest_path, Task* std_task, Task* std_compat_task);
+
+    void AddSystemIncludeDirs(BuildState& state, std::string_view compiler);
+
+    fs::path ArchivePath(const Target& target);
+    fs::path SharedLibraryPath(const Target& target);
+
+    // Hash of the dynamic symbols defined by a shared library, from nm
+    uint64_t HashExportedInterface(const fs::path& library);
+
+    // Thin archive, which only references its members. Replacing members just refreshes the symbol index
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects);
+
+    // Write a Make style depfile of the headers read next to the command's primary output
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command);
+}
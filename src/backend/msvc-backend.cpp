@@ -11,7 +11,6 @@ import std.compat;
 #include <filesystem>
 #include <print>
 #include <fstream>
-#include <unordered_set>
 #endif
 
 MsvcBackend::MsvcBackend()
@@ -65,82 +64,105 @@ void MsvcBackend::AddTaskInfo(std::span<Task> tasks) const
     }
 }
 
-bool MsvcBackend::CompileTask(const Task& task) const
+bool MsvcBackend::SupportsIncludeTranslation() const
 {
-    auto target_build_dir = HarmonyObjectDir / task.target->name;
-    fs::create_directories(target_build_dir);
+    return true;
+}
 
-    auto cmd = std::format("cd /d {} && cl", msvc::PathToCmdString(target_build_dir));
+Command MsvcBackend::GenerateCompileCommand(const Task& task, std::span<const Task> tasks) const
+{
+    auto target_build_dir = HarmonyObjectDir / task.target->name;
 
-    std::vector<std::string> cmds;
+    Command command{ .working_dir = target_build_dir, .outputs = { task.obj } };
 
     auto type = (task.inputs->type == SourceType::Unknown) ? task.source.type : task.inputs->type;
 
-    cmds.emplace_back(std::format("/c /nologo /std:c++latest /EHsc"));
+    for (auto arg : { "cl", "/c", "/nologo", "/std:c++latest", "/EHsc" }) command.Add(arg);
     switch (type) {
-        break;case SourceType::CSource: cmds.emplace_back(std::format("/TC {}", msvc::PathToCmdString(task.source.path)));
-        break;case SourceType::CppSource: cmds.emplace_back(std::format("/TP {}", msvc::PathToCmdString(task.source.path)));
+        break;case SourceType::CSource: command.Add("/TC");
+        break;case SourceType::CppSource: command.Add("/TP");
         break;case SourceType::CppHeader: {
             if (task.is_header_unit) {
-                cmds.emplace_back(std::format("/exportHeader /TP {}", msvc::PathToCmdString(task.source.path)));
+                command.Add("/exportHeader");
+                command.Add("/TP");
             } else Error("Attempted to compile header that isn't being exported as a header unit");
         }
-        break;case SourceType::CppInterface: cmds.emplace_back(std::format("/interface /TP {}", msvc::PathToCmdString(task.source.path)));
+        break;case SourceType::CppInterface:
+            command.Add("/interface");
+            command.Add("/TP");
         break;default: Error("Cannot compile: unknown source type!");
     }
+    command.AddPath({}, task.source.path, PathFormatOptions::Backward);
 
     // cmd += " /Zc:preprocessor /utf-8 /DUNICODE /D_UNICODE /permissive- /Zc:__cplusplus";
-    cmds.emplace_back("/Zc:preprocessor /permissive-");
-    cmds.emplace_back("/DWIN32 /D_WINDOWS /EHsc /Ob0 /Od /RTC1 -std:c++latest -MD");
+    for (auto arg : { "/Zc:preprocessor", "/permissive-" }) command.Add(arg);
+    for (auto arg : { "/DWIN32", "/D_WINDOWS", "/EHsc", "/Ob0", "/Od", "/RTC1", "-std:c++latest", "-MD" }) command.Add(arg);
     // cmd += " /O2 /Ob3";
     // cmd += " /W4";
 
-    // cmds.emplace_back("/FORCE /IGNORE:4006"); // When linking results from clang-cl that consume import std;
+    // command.Add("/FORCE"); command.Add("/IGNORE:4006"); // When linking results from clang-cl that consume import std;
 
     for (auto& include_dir : task.inputs->include_dirs) {
-        cmds.emplace_back(std::format("/I{}", msvc::PathToCmdString(include_dir)));
+        command.AddPath("/I", include_dir, PathFormatOptions::Backward);
     }
 
     for (auto& define : task.inputs->defines) {
-        cmds.emplace_back(std::format("/D{}", define));
+        command.AddFormat("/D{}", define);
     }
 
-    // TODO: FIXME - Should this be handled by shared build logic?
-    std::unordered_set<std::string_view> seen;
-    auto AddDependencies = [&cmds, &seen](this auto&& self, const Task& task) -> void {
-        for (auto& depends_on : task.depends_on) {
-
-            if (seen.contains(depends_on.name)) continue;
-            seen.emplace(depends_on.name);
-
-            if (depends_on.source->is_header_unit) {
-                cmds.emplace_back(std::format("/headerUnit {}={}", msvc::PathToCmdString(depends_on.source->source.path), msvc::PathToCmdString(depends_on.source->bmi)));
-            } else {
-                cmds.emplace_back(std::format("/reference {}={}", depends_on.name, msvc::PathToCmdString(depends_on.source->bmi)));
-            }
-            self(*depends_on.source);
+    for (auto reference : task.references) {
+        auto& source = tasks[reference];
+        if (source.is_header_unit) {
+            command.Add("/headerUnit");
+            command.AddFormat("{}={}", msvc::PathToArg(source.source.path), msvc::PathToArg(source.bmi));
+        } else {
+            command.Add("/reference");
+            command.AddFormat("{}={}", source.produces.front(), msvc::PathToArg(source.bmi));
         }
-    };
+    }
 
-    AddDependencies(task);
+    if (task.translate_includes) {
+        // Only applies to headers passed with /headerUnit
+        command.Add("/translateInclude");
+    }
 
-    cmds.emplace_back(std::format("/ifcOutput {}", task.bmi.filename().string()));
+    command.Add("/ifcOutput");
+    command.Add(task.bmi.filename().string());
     // if (!task.is_header_unit) {
-        cmds.emplace_back(std::format("/Fo:{}", task.obj.filename().string()));
+        command.AddFormat("/Fo:{}", task.obj.filename().string());
     // }
 
-    // Generate cmd string, use command files to avoid cmd line size limit
+    if (type == SourceType::CppInterface || task.is_header_unit) {
+        command.outputs.emplace_back(task.bmi);
+    }
+    return command;
+}
 
-    msvc::SafeCompleteCmd(cmd, cmds);
+bool MsvcBackend::LinksObject(const Task& task) const
+{
+    // Header units have objects as well
+    HARMONY_IGNORE(task)
+    return true;
+}
 
-    LogCmd(cmd);
+fs::path MsvcBackend::ArchivePath(const Target& target) const
+{
+    return msvc::ArchivePath(target);
+}
 
-    return std::system(cmd.c_str()) == 0;
+Command MsvcBackend::GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update) const
+{
+    return msvc::GenerateArchiveCommand(target, objects, update);
+}
+
+HeaderDependencyFormat MsvcBackend::AddHeaderDependencyFlags(Command& command) const
+{
+    return msvc::AddHeaderDependencyFlags(command);
 }
 
-bool MsvcBackend::LinkStep(Target& target, std::span<const Task> tasks) const
+Command MsvcBackend::GenerateLinkCommand(const Target& target, std::span<const Task> tasks) const
 {
-    return msvc::LinkStep(target, tasks);
+    return msvc::GenerateLinkCommand(*this, target, tasks);
 }
 
 void MsvcBackend::AddSystemIncludeDirs(BuildState& state) const
@@ -84,39 +84,9 @@ namespace msvc
         return FormatPath(path, PathFormatOptions::Backward | PathFormatOptions::QuoteSpaces | PathFormatOptions::Absolute);
     }
 
-    void SafeCompleteCmd(std::string& cmd, const std::vector<std::string>& cmds)
+    std::string PathToArg(const fs::path& path)
     {
-        auto cmd_dir = HarmonyTempDir;
-
-        size_t cmd_length = cmd.size();
-        for (auto& cmd_part : cmds) {
-            cmd_length += 1 + cmd_part.size();
-        }
-
-        constexpr uint32_t CmdSizeLimit = 4000;
-
-        if (cmd_length > CmdSizeLimit) {
-            static std::atomic_uint32_t cmd_file_id = 0;
-
-            fs::create_directories(cmd_dir);
-            auto cmd_path = cmd_dir / std::format("cmd.{}", cmd_file_id++);
-            std::ofstream out(cmd_path, std::ios::binary);
-            for (uint32_t i = 0; i < cmds.size(); ++i) {
-                if (i > 0) out.write("\n", 1);
-                out.write(cmds[i].data(), cmds[i].size());
-            }
-            out.flush();
-            out.close();
-
-            cmd += " @";
-            cmd += PathToCmdString(cmd_path);
-
-        } else {
-            for (auto& cmd_part : cmds) {
-                cmd += " ";
-                cmd += cmd_part;
-            }
-        }
+        return FormatPath(path, PathFormatOptions::Backward | PathFormatOptions::Absolute);
     }
 }
 
@@ -150,47 +120,69 @@ namespace msvc
 
 namespace msvc
 {
-    bool LinkStep(Target& target, std::span<const Task> tasks)
+    Command GenerateLinkCommand(const Backend& backend, const Target& target, std::span<const Task> tasks)
     {
         auto& executable = target.executable.value();
 
         auto output_file = HarmonyObjectDir / target.name / std::format("{}.exe", executable.name);
-        executable.built_path = output_file;
-        fs::create_directories(output_file.parent_path());
 
-        auto cmd = std::format("cd /d {} && link /nologo", msvc::PathToCmdString(output_file.parent_path()));
-        std::vector<std::string> cmds;
+        Command command{ .working_dir = output_file.parent_path(), .outputs = { output_file } };
+
+        command.Add("link");
+        command.Add("/nologo");
         switch (executable.type) {
-            break;case ExecutableType::Console: cmds.emplace_back("/subsystem:console");
-            break;case ExecutableType::Window: cmds.emplace_back("/subsystem:window");
+            break;case ExecutableType::Console: command.Add("/subsystem:console");
+            break;case ExecutableType::Window: command.Add("/subsystem:window");
         }
-        cmds.emplace_back(std::format("/OUT:{}", output_file.filename().string()));
-        for (auto& task : tasks) {
-            if (!target.flattened_imports.contains(task.target) && &target != task.target) continue;
-            if (!fs::exists(task.obj)) {
-                LogWarn("Could not find obj for [{}]", task.unique_name);
-            }
-            cmds.emplace_back(msvc::PathToCmdString(task.obj));
+        command.AddFormat("/OUT:{}", output_file.filename().string());
+        ForEachObject(backend, target, tasks, [&](auto& obj) {
+            command.AddPath({}, obj, PathFormatOptions::Backward);
+        });
+
+        ForEachImportedLibrary(backend, target, tasks, [&](auto&, auto& archive) {
+            command.AddPath({}, archive, PathFormatOptions::Backward);
+        });
+
+        for (auto lib : { "user32.lib", "gdi32.lib", "shell32.lib", "Winmm.lib", "Advapi32.lib", "Comdlg32.lib", "comsuppw.lib", "onecore.lib" }) {
+            command.Add(lib);
         }
 
-        cmds.emplace_back("user32.lib");
-        cmds.emplace_back("gdi32.lib");
-        cmds.emplace_back("shell32.lib");
-        cmds.emplace_back("Winmm.lib");
-        cmds.emplace_back("Advapi32.lib");
-        cmds.emplace_back("Comdlg32.lib");
-        cmds.emplace_back("comsuppw.lib");
-        cmds.emplace_back("onecore.lib");
-
-        msvc::ForEachLink(target, [&](auto& link) {
-            cmds.emplace_back(msvc::PathToCmdString(link));
+        ForEachLink(target, [&](auto& link) {
+            command.AddPath({}, link, PathFormatOptions::Backward);
         });
 
-        msvc::SafeCompleteCmd(cmd, cmds);
+        return command;
+    }
 
-        LogCmd(cmd);
+    fs::path ArchivePath(const Target& target)
+    {
+        return HarmonyObjectDir / target.name / std::format("{}.lib", target.name);
+    }
 
-        return std::system(cmd.c_str()) == 0;
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update)
+    {
+        auto archive = ArchivePath(target);
+
+        Command command{ .working_dir = archive.parent_path(), .outputs = { archive } };
+
+        command.Add("lib");
+        command.Add("/nologo");
+        command.AddFormat("/OUT:{}", archive.filename().string());
+        if (update) {
+            // Objects replace members of the same name in the existing library
+            command.AddPath({}, archive, PathFormatOptions::Backward);
+        }
+        for (auto& object : objects) {
+            command.AddPath({}, object, PathFormatOptions::Backward);
+        }
+
+        return command;
+    }
+
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command)
+    {
+        command.Add("/showIncludes");
+        return HeaderDependencyFormat::Msvc;
     }
 
     void AddSystemIncludeDirs(BuildState& state)
@@ -209,64 +201,4 @@ namespace msvc
             start = end + 1;
         }
     }
-
-    void ForEachLink(const Target& target, function_ref<void(const fs::path&)> callback)
-    {
-        // TODO: Move this to shared logic!
-        // TODO: Backend should only care about identifying .lib extensions
-        auto AddLinks = [&](const Target& t) {
-            LogTrace("Adding links for: [{}]", t.name);
-            for (auto& link : t.links) {
-                if (fs::is_regular_file(link)) {
-                    LogTrace("    adding: [{}]", link.string());
-                    callback(link);
-                } else if (fs::is_directory(link)) {
-                    LogTrace("  finding links in: [{}]", link.string());
-                    for (auto iter : fs::directory_iterator(link)) {
-                        auto path = iter.path();
-                        if (path.extension() == ".lib") {
-                            LogTrace("    adding: [{}]", path.string());
-                            callback(path);
-                        }
-                    }
-                } else {
-                    LogWarn("link path not found: [{}]", link.string());
-                }
-            }
-        };
-        AddLinks(target);
-        for (auto* import_target : target.flattened_imports) {
-            AddLinks(*import_target);
-        }
-    }
-
-    void ForEachShared(const Target& target, function_ref<void(const fs::path&)> callback)
-    {
-        // TODO: Move this to shared logic!
-        // TODO: Backend should only care about identifying .dll extensions
-        auto AddShared = [&](const Target& t) {
-            LogTrace("Adding shared libraries for: [{}]", t.name);
-            for (auto& shared : t.shared) {
-                if (fs::is_regular_file(shared)) {
-                    LogTrace("    adding: [{}]", shared.string());
-                    callback(shared);
-                } else if (fs::is_directory(shared)) {
-                    LogTrace("  finding shared libraries in: [{}]", shared.string());
-                    for (auto iter : fs::directory_iterator(shared)) {
-                        auto path = iter.path();
-                        if (path.extension() == ".dll") {
-                            LogTrace("    adding: [{}]", path.string());
-                            callback(path);
-                        }
-                    }
-                } else {
-                    LogWarn("shared library path not found: [{}]", shared.string());
-                }
-            }
-        };
-        AddShared(target);
-        for (auto* import_target : target.flattened_imports) {
-            AddShared(*import_target);
-        }
-    }
 }
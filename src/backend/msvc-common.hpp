@@ -12,15 +12,18 @@ namespace msvc
     void EnsureVisualStudioEnvironment();
     fs::path GetVisualStudioStdModulesDir();
 
-    void SafeCompleteCmd(std::string& cmd, const std::vector<std::string>& cmds);
     std::string PathToCmdString(const fs::path& path);
+    std::string PathToArg(const fs::path& path);
 
     void GenerateStdModuleTasks(Task* std_task, Task* std_compat_task);
 
-    bool LinkStep(Target& target, std::span<const Task> tasks);
+    Command GenerateLinkCommand(const Backend& backend, const Target& target, std::span<const Task> tasks);
 
-    void AddSystemIncludeDirs(BuildState& state);
+    fs::path ArchivePath(const Target& target);
+    Command GenerateArchiveCommand(const Target& target, std::span<const fs::path> objects, bool update);
+
+    // Print the headers read as /showIncludes notes
+    HeaderDependencyFormat AddHeaderDependencyFlags(Command& command);
 
-    void ForEachLink(const Target& target, function_ref<void(const fs::path&)>);
-    void ForEachShared(const Target& target, function_ref<void(const fs::path&)>);
+    void AddSystemIncludeDirs(BuildState& state);
 }
@@ -0,0 +1,103 @@
+#include <xxhash.h>
+
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <build.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <unordered_set>
+#include <unordered_map>
+#endif
+
+static
+std::string_view DefineKey(std::string_view define)
+{
+    return define.substr(0, define.find('='));
+}
+
+void TranslationInputs::MergeBack(const TranslationInputs& other)
+{
+    if (type == SourceType::Unknown) type = other.type;
+
+    // Imported defines come first so that local defines are emitted last, keep only the last definition of each key
+
+    {
+        std::vector<std::string> merged;
+        merged.reserve(other.defines.size() + defines.size());
+        std::unordered_set<std::string_view> seen;
+        auto Collect = [&](const std::vector<std::string>& source) {
+            for (auto i = source.size(); i-- > 0;) {
+                if (seen.emplace(DefineKey(source[i])).second) {
+                    merged.emplace_back(source[i]);
+                }
+            }
+        };
+        Collect(defines);
+        Collect(other.defines);
+        std::ranges::reverse(merged);
+        defines = std::move(merged);
+    }
+
+    // Include search order is significant, keep the first occurrence of each path
+
+    auto Append = [](std::vector<fs::path>& target, const std::vector<fs::path>& source) {
+        std::vector<fs::path> merged;
+        merged.reserve(target.size() + source.size());
+        std::unordered_set<fs::path> seen;
+        for (auto& path : target) if (seen.emplace(path).second) merged.emplace_back(std::move(path));
+        for (auto& path : source) if (seen.emplace(path).second) merged.emplace_back(path);
+        target = std::move(merged);
+    };
+
+    Append(include_dirs, other.include_dirs);
+    Append(force_includes, other.force_includes);
+}
+
+uint64_t TranslationInputs::ComputeHash() const
+{
+    auto state = XXH64_createState();
+    HARMONY_DEFER(&) { XXH64_freeState(state); };
+    XXH64_reset(state, 0);
+
+    auto Update = [&](std::string_view str) {
+        XXH64_update(state, str.data(), str.size());
+        // Separator to avoid collisions between adjacent entries
+        XXH64_update(state, "", 1);
+    };
+
+    auto type_value = std::to_underlying(type);
+    XXH64_update(state, &type_value, sizeof(type_value));
+
+    Update("defines");
+    for (auto& define : defines) Update(define);
+    Update("include_dirs");
+    for (auto& include : include_dirs) Update(include.generic_string());
+    Update("force_includes");
+    for (auto& finclude : force_includes) Update(finclude.generic_string());
+
+    return XXH64_digest(state);
+}
+
+const InternedTranslationInputs* TranslationInputsPool::Intern(TranslationInputs&& inputs)
+{
+    auto hash = inputs.ComputeHash();
+
+    auto[begin, end] = entries.equal_range(hash);
+    for (auto iter = begin; iter != end; ++iter) {
+        if (static_cast<const TranslationInputs&>(*iter->second) == inputs) {
+            return iter->second.get();
+        }
+    }
+
+    auto interned = std::make_unique<InternedTranslationInputs>();
+    static_cast<TranslationInputs&>(*interned) = std::move(inputs);
+    interned->hash = hash;
+
+    LogTrace("Interned translation inputs [{:x}] ({} defines, {} include dirs)",
+        hash, interned->defines.size(), interned->include_dirs.size());
+
+    return entries.emplace(hash, std::move(interned))->second.get();
+}
@@ -0,0 +1,172 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <build-log.hpp>
+#include <json.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <charconv>
+#include <unordered_set>
+#endif
+
+static constexpr uint64_t BuildLogVersion = 1;
+
+void BuildLog::Load(const fs::path& path)
+{
+    std::scoped_lock lock{mutex};
+
+    entries.clear();
+    inputs.clear();
+
+    if (!fs::exists(path)) return;
+
+    LogDebug("Loading build log from [{}]", path.string());
+
+    // An interrupted or concurrent write must not prevent later builds, the log only speeds them up
+    auto contents = ReadFileToString(path);
+    JsonDocument doc(contents, std::nothrow);
+    if (!doc) {
+        LogWarn("Build log [{}] is malformed, starting with an empty log", path.string());
+        return;
+    }
+    auto root = doc.root();
+
+    if (root["version"].uint64().value_or(0) != BuildLogVersion) {
+        LogDebug("  Build log version mismatch, ignoring");
+        return;
+    }
+
+    for (auto[key, value] : root["tasks"].iter()) {
+        auto& entry = entries[key];
+        auto& usage = entry.usage;
+        usage.wall = chr::nanoseconds(value["wall"].uint64().value_or(0));
+        usage.user_cpu = chr::nanoseconds(value["user"].uint64().value_or(0));
+        usage.system_cpu = chr::nanoseconds(value["system"].uint64().value_or(0));
+        usage.peak_memory = value["peak_memory"].uint64().value_or(0);
+        usage.io_read = value["io_read"].uint64().value_or(0);
+        usage.io_write = value["io_write"].uint64().value_or(0);
+        entry.inputs_hash = value["inputs_hash"].uint64().value_or(0);
+    }
+
+    for (auto[key, value] : root["inputs"].iter()) {
+        std::string_view key_str = key;
+        uint64_t hash = 0;
+        if (std::from_chars(key_str.data(), key_str.data() + key_str.size(), hash, 16).ec != std::errc{}) continue;
+
+        auto& recorded = inputs[hash];
+        recorded.type = uint8_t(value["type"].uint64().value_or(0));
+        recorded.position_independent = value["position_independent"].uint64().value_or(0) != 0;
+        auto ReadStrings = [&](std::vector<std::string>& out, const char* name) {
+            for (auto str : value[name]) {
+                if (auto chars = str.string()) out.emplace_back(chars);
+            }
+        };
+        ReadStrings(recorded.defines, "defines");
+        ReadStrings(recorded.include_dirs, "include_dirs");
+        ReadStrings(recorded.force_includes, "force_includes");
+    }
+
+    LogDebug("  Loaded {} entries", entries.size());
+}
+
+void BuildLog::Save(const fs::path& path)
+{
+    std::scoped_lock lock{mutex};
+
+    LogDebug("Saving build log ({} entries) to [{}]", entries.size(), path.string());
+
+    // Sort keys so that unchanged logs produce identical files
+    std::vector<const std::pair<const std::string, BuildLogEntry>*> sorted;
+    sorted.reserve(entries.size());
+    for (auto& entry : entries) sorted.emplace_back(&entry);
+    std::ranges::sort(sorted, {}, [](auto* entry) -> const std::string& { return entry->first; });
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("version", BuildLogVersion);
+    json.Key("tasks").BeginObject();
+    for (auto* entry : sorted) {
+        auto& usage = entry->second.usage;
+        json.Key(entry->first).BeginObject()
+            .Field("wall", uint64_t(usage.wall.count()))
+            .Field("user", uint64_t(usage.user_cpu.count()))
+            .Field("system", uint64_t(usage.system_cpu.count()))
+            .Field("peak_memory", usage.peak_memory)
+            .Field("io_read", usage.io_read)
+            .Field("io_write", usage.io_write)
+            .Field("inputs_hash", entry->second.inputs_hash)
+            .EndObject();
+    }
+    json.EndObject();
+
+    std::vector<uint64_t> referenced;
+    {
+        std::unordered_set<uint64_t> seen;
+        for (auto* entry : sorted) {
+            auto hash = entry->second.inputs_hash;
+            if (inputs.contains(hash) && seen.emplace(hash).second) referenced.emplace_back(hash);
+        }
+    }
+    std::ranges::sort(referenced);
+
+    json.Key("inputs").BeginObject();
+    for (auto hash : referenced) {
+        auto& recorded = inputs.at(hash);
+        json.Key(std::format("{:016x}", hash)).BeginObject()
+            .Field("type", recorded.type)
+            .Field("position_independent", uint64_t(recorded.position_independent));
+        auto WriteStrings = [&](std::string_view name, const std::vector<std::string>& values) {
+            json.Key(name).BeginArray();
+            for (auto& value : values) json.String(value);
+            json.EndArray();
+        };
+        WriteStrings("defines", recorded.defines);
+        WriteStrings("include_dirs", recorded.include_dirs);
+        WriteStrings("force_includes", recorded.force_includes);
+        json.EndObject();
+    }
+    json.EndObject();
+
+    json.EndObject();
+
+    fs::create_directories(path.parent_path());
+    WriteFileIfChanged(path, json.out);
+}
+
+void BuildLog::Record(const std::string& key, const ResourceUsage& usage, uint64_t inputs_hash)
+{
+    std::scoped_lock lock{mutex};
+    auto& entry = entries[key];
+    entry.usage = usage;
+    entry.inputs_hash = inputs_hash;
+}
+
+std::optional<BuildLogEntry> BuildLog::Find(const std::string& key)
+{
+    std::scoped_lock lock{mutex};
+    auto iter = entries.find(key);
+    if (iter == entries.end()) return std::nullopt;
+    return iter->second;
+}
+
+bool BuildLog::HasInputs(uint64_t inputs_hash)
+{
+    std::scoped_lock lock{mutex};
+    return inputs.contains(inputs_hash);
+}
+
+void BuildLog::RecordInputs(uint64_t inputs_hash, BuildLogInputs recorded)
+{
+    std::scoped_lock lock{mutex};
+    inputs.try_emplace(inputs_hash, std::move(recorded));
+}
+
+std::optional<BuildLogInputs> BuildLog::FindInputs(uint64_t inputs_hash)
+{
+    std::scoped_lock lock{mutex};
+    auto iter = inputs.find(inputs_hash);
+    if (iter == inputs.end()) return std::nullopt;
+    return iter->second;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <process.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <mutex>
+#include <unordered_map>
+#endif
+
+// -----------------------------------------------------------------------------
+//  Persistent record of per-task results from previous builds
+// -----------------------------------------------------------------------------
+
+struct BuildLogEntry
+{
+    ResourceUsage usage;
+    // TranslationInputs::ComputeHash of the last successful compile, 0 if unknown
+    uint64_t inputs_hash = 0;
+};
+
+// Translation inputs behind a recorded inputs hash, kept to explain which inputs changed
+struct BuildLogInputs
+{
+    uint8_t type = 0;
+    std::vector<std::string> defines;
+    std::vector<std::string> include_dirs;
+    std::vector<std::string> force_includes;
+    bool position_independent = false;
+};
+
+struct BuildLog
+{
+    std::mutex mutex;
+    std::unordered_map<std::string, BuildLogEntry> entries;
+    // Only inputs referenced by entries are saved
+    std::unordered_map<uint64_t, BuildLogInputs> inputs;
+
+    void Load(const fs::path& path);
+    void Save(const fs::path& path);
+
+    void Record(const std::string& key, const ResourceUsage& usage, uint64_t inputs_hash = 0);
+    std::optional<BuildLogEntry> Find(const std::string& key);
+
+    bool HasInputs(uint64_t inputs_hash);
+    void RecordInputs(uint64_t inputs_hash, BuildLogInputs recorded);
+    std::optional<BuildLogInputs> FindInputs(uint64_t inputs_hash);
+};
+
+inline const fs::path BuildLogPath = HarmonyDir / "build-log.json";
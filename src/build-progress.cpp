@@ -0,0 +1,133 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <build.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <algorithm>
+#include <atomic>
+#endif
+
+static constexpr chr::milliseconds ProgressEstimateInterval{250};
+static constexpr uint32_t ProgressMaxRunningNames = 3;
+
+BuildProgress::BuildProgress(BuildState& _state)
+    : state(_state)
+    , terminal(LogIsTerminal())
+    , enabled(IsLogLevel(LogLevel::Info))
+    , estimates(state.tasks.size())
+    , started(state.tasks.size())
+    , finish(state.tasks.size())
+{
+    if (!enabled) return;
+
+    // Estimate task durations from previous builds, falling back to the mean of known tasks
+
+    std::vector<uint32_t> unknown;
+    chr::nanoseconds known_total{};
+    uint32_t known_count = 0;
+    for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+        auto& task = state.tasks[i];
+        if (task.state != TaskState::Waiting) continue;
+        total++;
+        if (auto entry = state.build_log.Find(BuildLogKey(task)); entry && entry->usage.wall.count()) {
+            estimates[i] = entry->usage.wall;
+            known_total += entry->usage.wall;
+            known_count++;
+        } else {
+            unknown.emplace_back(i);
+        }
+    }
+
+    auto fallback = known_count ? known_total / known_count : chr::nanoseconds(chr::seconds(1));
+    for (auto i : unknown) {
+        estimates[i] = fallback;
+    }
+
+    LogDebug("Estimated {} task durations from build log ({} unknown)", known_count, unknown.size());
+}
+
+BuildProgress::~BuildProgress()
+{
+    if (terminal) LogStatus({});
+}
+
+void BuildProgress::Started(uint32_t task)
+{
+    started[task] = chr::steady_clock::now();
+}
+
+void BuildProgress::EstimateRemaining(chr::steady_clock::time_point now)
+{
+    // Longest remaining chain of estimated durations through incomplete tasks. Tasks are visited in dependency
+    // order so each dependency's finish time is known before its dependents
+
+    chr::nanoseconds critical_path{};
+    chr::nanoseconds total_work{};
+    for (auto index : state.order) {
+        auto& task = state.tasks[index];
+        auto task_state = std::atomic_ref(task.state).load();
+        finish[index] = {};
+        if (task_state == TaskState::Complete || task_state == TaskState::Failed) continue;
+
+        auto task_remaining = estimates[index];
+        if (task_state == TaskState::Compiling) {
+            task_remaining = std::max(chr::nanoseconds{}, task_remaining - (now - started[index]));
+        }
+
+        chr::nanoseconds ready{};
+        for (auto& dep : task.depends_on) {
+            ready = std::max(ready, finish[dep.source]);
+        }
+
+        finish[index] = ready + task_remaining;
+        critical_path = std::max(critical_path, finish[index]);
+        total_work += task_remaining;
+    }
+
+    remaining = std::max(critical_path, total_work / std::max(1u, state.stats.max_threads));
+    last_estimate = now;
+}
+
+void BuildProgress::Update()
+{
+    if (!enabled) return;
+
+    auto now = chr::steady_clock::now();
+    auto& records = state.stats.task_records;
+
+    if (records.size() != reported || now - last_estimate > ProgressEstimateInterval) {
+        EstimateRemaining(now);
+    }
+
+    if (!terminal) {
+        // Plain output, one line per finished task
+        for (; reported < records.size(); ++reported) {
+            auto& record = records[reported];
+            LogInfo("[{}/{}] {}{} (ETA {})", reported + 1, total,
+                state.tasks[record.task].unique_name, record.success ? "" : " failed",
+                DurationToString(remaining));
+        }
+        return;
+    }
+
+    reported = records.size();
+
+    std::string status = std::format("[{}/{}]", reported, total);
+    uint32_t running = 0;
+    for (auto index : state.order) {
+        if (std::atomic_ref(state.tasks[index].state).load() != TaskState::Compiling) continue;
+        if (running < ProgressMaxRunningNames) {
+            std::format_to(std::back_inserter(status), "{} {}", running ? "," : "", state.tasks[index].unique_name);
+        }
+        running++;
+    }
+    if (running > ProgressMaxRunningNames) {
+        std::format_to(std::back_inserter(status), " (+{} more)", running - ProgressMaxRunningNames);
+    }
+    std::format_to(std::back_inserter(status), " | ETA {}", DurationToString(remaining));
+
+    LogStatus(std::move(status));
+}
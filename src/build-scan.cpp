@@ -13,6 +13,10 @@ import std.compat;
 
 #include <math.h>
 
+#ifndef HARMONY_USE_IMPORT_STD
+#include <numeric>
+#endif
+
 static
 bool ws(char c)
 {
@@ -136,6 +140,9 @@ ScanResult ScanFile(const fs::path& path, std::string& data, function_ref<void(C
 
     std::string_view primary_module_name;
 
+    // Set from 'module;' until the module declaration or the first directive other than #include
+    bool global_fragment_prefix = false;
+
     while (cur <= data_end) {
         SkipWhitespaceAndCommments();
 
@@ -143,6 +150,7 @@ ScanResult ScanFile(const fs::path& path, std::string& data, function_ref<void(C
             while (ws(*++cur));
             HARONY_BUILD_SCAN_LOG_TRACE("Checking for 'include' directive [{}]", std::string_view(cur, cur + 7));
             if (std::string_view(cur, cur + 7) != "include") {
+                global_fragment_prefix = false;
                 HARONY_BUILD_SCAN_LOG_TRACE("  not found, skipping to next unescaped newline");
                 SkipToEndOfLine();
                 HARONY_BUILD_SCAN_LOG_TRACE("  reached end of preprocessor statement");
@@ -169,6 +177,7 @@ ScanResult ScanFile(const fs::path& path, std::string& data, function_ref<void(C
             comp.type = Component::Type::Header;
             comp.imported = true;
             comp.angled = angled;
+            comp.global_fragment_prefix = global_fragment_prefix;
 
             callback(comp);
         }
@@ -207,8 +216,9 @@ ScanResult ScanFile(const fs::path& path, std::string& data, function_ref<void(C
             SkipWhitespaceAndCommments();
             PeekFalse(cur);
             if (*cur == ';') {
-                // Global module fragment, ignore
-                HARONY_BUILD_SCAN_LOG_TRACE("global module fragment, ignore");
+                // Global module fragment
+                HARONY_BUILD_SCAN_LOG_TRACE("global module fragment");
+                global_fragment_prefix = !is_imported;
                 ++cur; continue;
             }
             if (*cur == '"' || *cur == '<') {
@@ -280,6 +290,7 @@ ScanResult ScanFile(const fs::path& path, std::string& data, function_ref<void(C
                 }
             } else {
                 primary_module_name = name;
+                global_fragment_prefix = false;
             }
             if (is_header_unit) {
                 LogTrace("{}import {}{}{};", is_exported ? "export " : "", angled ? '<' : '"', name, angled ? '>' : '"');
@@ -366,14 +377,173 @@ std::optional<fs::path> FindInclude(fs::path path, std::string_view include, boo
     return std::nullopt;
 }
 
+fs::file_time_type NewestIncludeTime(BuildState& state, std::span<const PathId> headers, std::span<const fs::path> include_dirs)
+{
+    std::unordered_set<PathId> visited;
+    std::vector<PathId> pending(headers.begin(), headers.end());
+    std::string storage;
+    fs::file_time_type newest{};
+    while (!pending.empty()) {
+        auto id = pending.back();
+        pending.pop_back();
+        if (!visited.emplace(id).second) continue;
+
+        auto& path = PathFromId(id);
+        std::error_code ec;
+        newest = std::max(newest, fs::last_write_time(path, ec));
+        if (ec) continue;
+
+        ScanFile(path, storage, [&](Component& comp) {
+            if (comp.type != Component::Type::Header) return;
+            bool is_system;
+            if (auto included = FindInclude(path, comp.name, comp.angled, include_dirs, state, is_system)) {
+                pending.emplace_back(InternPath(*included));
+            }
+        });
+    }
+    return newest;
+}
+
+struct ScannedInclude
+{
+    PathId path;
+    NameId name;
+    bool is_system;
+};
+
+// Rough front-end throughput, used to estimate parse times of headers that have never been built as header units
+static constexpr uint64_t EstimatedParseBytesPerSecond = 1024 * 1024;
+
+static
+bool IsImportableLibraryHeader(std::string_view name)
+{
+    // The C++ library headers are importable, the <cname> headers for C library facilities are not
+    static constexpr std::string_view CLibraryHeaders[] = {
+        "cassert", "cctype", "cerrno", "cfenv", "cfloat", "cinttypes", "climits", "clocale", "cmath", "csetjmp",
+        "csignal", "cstdarg", "cstddef", "cstdint", "cstdio", "cstdlib", "cstring", "ctime", "cuchar", "cwchar",
+        "cwctype",
+    };
+    if (name.contains('.') || name.contains('/')) return false;
+    return !std::ranges::contains(CLibraryHeaders, name);
+}
+
+static
+void PromoteHeaderUnits(BuildState& state, std::span<std::vector<ScannedInclude>> task_includes, std::unordered_map<PathId, NameId>& marked_header_units)
+{
+    if (!state.backend->SupportsIncludeTranslation()) {
+        LogWarn("Backend does not support include translation, no headers will be promoted to header units");
+        return;
+    }
+
+    LogDebug("Promoting frequently included headers to header units");
+
+    // Only headers tracked as project sources and importable library headers are candidates, anything else may
+    // depend on macros defined by the including file
+
+    std::unordered_set<PathId> project_headers;
+    for (auto& task : state.tasks) {
+        if (task.source.type == SourceType::CppHeader) project_headers.emplace(InternPath(task.source.path));
+    }
+
+    struct Candidate
+    {
+        PathId path;
+        uint32_t fan_in = 0;
+    };
+
+    std::unordered_map<PathId, Candidate> candidates;
+    for (auto& includes : task_includes) {
+        // Count each including file once
+        std::ranges::sort(includes, {}, &ScannedInclude::path);
+        auto[first, last] = std::ranges::unique(includes, {}, &ScannedInclude::path);
+        includes.erase(first, last);
+
+        for (auto& include : includes) {
+            if (include.is_system ? !IsImportableLibraryHeader(NameToString(include.name)) : !project_headers.contains(include.path)) continue;
+            auto& candidate = candidates[include.path];
+            if (!candidate.fan_in) candidate.path = include.path;
+            candidate.fan_in++;
+        }
+    }
+
+    std::vector<Candidate> ranked;
+    for (auto&[path, candidate] : candidates) {
+        if (candidate.fan_in > 1) ranked.emplace_back(candidate);
+    }
+    std::ranges::sort(ranked, [](const Candidate& l, const Candidate& r) {
+        if (l.fan_in != r.fan_in) return l.fan_in > r.fan_in;
+        return PathFromId(l.path) < PathFromId(r.path);
+    });
+    if (ranked.size() > state.options.promote_header_units) ranked.resize(state.options.promote_header_units);
+
+    // Each include of a promoted header saves parsing it again, header units that were built before use their
+    // logged compile time and others are estimated from their size
+
+    BuildLog build_log;
+    build_log.Load(state.options.build_log);
+
+    std::unordered_map<PathId, NameId> promoted;
+    chr::nanoseconds estimated_saving{};
+    for (auto& candidate : ranked) {
+        // Promoted units are named by their path, the same include spelling (e.g. "config.h") can resolve to
+        // different headers in different directories. Headers already imported explicitly keep their name
+        auto& path = PathFromId(candidate.path);
+        auto[iter, inserted] = marked_header_units.try_emplace(candidate.path, InternName(path.generic_string()));
+        promoted.emplace(candidate.path, iter->second);
+
+        chr::nanoseconds parse_time;
+        if (auto entry = build_log.Find(std::format("compile:{}", path.generic_string()))) {
+            parse_time = entry->usage.wall;
+        } else {
+            std::error_code ec;
+            auto size = fs::file_size(path, ec);
+            parse_time = ec ? chr::nanoseconds{} : chr::nanoseconds(size * 1'000'000'000 / EstimatedParseBytesPerSecond);
+        }
+        estimated_saving += parse_time * (candidate.fan_in - 1);
+
+        LogDebug("  [{}] included by {} files, ~{} per parse", path.string(), candidate.fan_in, DurationToString(parse_time));
+    }
+
+    uint32_t translated = 0;
+    for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+        auto& task = state.tasks[i];
+        // Header units are compiled from their textual includes
+        if (task.source.type == SourceType::CppHeader) continue;
+
+        for (auto& include : task_includes[i]) {
+            auto iter = promoted.find(include.path);
+            if (iter == promoted.end()) continue;
+
+            translated++;
+            task.translate_includes = true;
+            if (!std::ranges::contains(task.depends_on, iter->second, &Dependency::name)) {
+                task.depends_on.emplace_back(Dependency{.name = iter->second});
+            }
+
+            if (include.is_system) {
+                // TODO: We should track these per source instead of per target
+                task.target->imported_targets["std"] = DependencyType::Private;
+            }
+        }
+    }
+
+    LogInfo("Promoted {} headers to header units, translating {} includes (estimated {} of parsing saved)",
+        promoted.size(), translated, DurationToString(estimated_saving));
+}
+
 void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
 {
     LogInfo("Scanning dependencies");
 
-    std::unordered_map<fs::path, std::string> marked_header_units;
+    std::unordered_map<PathId, NameId> marked_header_units;
 
     auto backend_scan_differences = 0;
 
+    std::vector<std::vector<ScannedInclude>> task_includes;
+    if (state.options.promote_header_units) {
+        task_includes.resize(state.tasks.size());
+    }
+
     std::vector<std::string> dependency_info;
     if (use_backend_dependency_scan) {
         dependency_info.resize(state.tasks.size());
@@ -384,6 +554,9 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
     }
 
     {
+        auto scan_start = chr::steady_clock::now();
+        HARMONY_DEFER(&) { state.stats.scan_time += chr::steady_clock::now() - scan_start; };
+
         std::string scan_storage;
         std::unordered_map<std::string, int> produced_set;
         std::unordered_map<std::string, int> required_set;
@@ -403,19 +576,19 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
                         auto logical_name = provided["logical-name"].string();
                         produced_set[logical_name]++;
                         LogTrace("produces module [{}]", logical_name);
-                        task.produces.emplace_back(logical_name);
+                        task.produces.emplace_back(InternName(logical_name));
                     }
 
                     for (auto required : rule["requires"]) {
                         auto logical_name = required["logical-name"].string();
                         required_set[logical_name]++;
                         // LogTrace("  requires: {}", logical_name);
-                        task.depends_on.emplace_back(Dependency{.name = std::string(logical_name)});
+                        task.depends_on.emplace_back(Dependency{.name = InternName(logical_name)});
                         if (auto source_path = required["source-path"]) {
-                            auto path = fs::path(source_path.string());
-                            // LogTrace("    is header unit - {}", path.string());
-                            marked_header_units[path] = logical_name;
-                            LogTrace("requires header [{}]", path.string());
+                            auto path = InternPath(source_path.string());
+                            // LogTrace("    is header unit - {}", path);
+                            marked_header_units[path] = InternName(logical_name);
+                            LogTrace("requires header [{}]", path);
                         } else {
                             LogTrace("requires module [{}]", logical_name);
                         }
@@ -425,17 +598,30 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
                 LogDebug("  build-deps results:");
             }
 
+            // The prefix ends at the first include that can't be resolved, it could never be precompiled
+            bool collect_global_fragment = state.options.auto_pch;
+
             auto scan_result = ScanFile(task.source.path, scan_storage, [&](Component& comp) {
                 if (comp.type == Component::Type::Header) {
                     bool is_system;
-                    FindInclude(task.source.path, comp.name, comp.angled, task.inputs->include_dirs, state, is_system);
+                    auto included = FindInclude(task.source.path, comp.name, comp.angled, task.inputs->include_dirs, state, is_system);
+                    if (included && !task_includes.empty()) {
+                        task_includes[i].emplace_back(InternPath(*included), InternName(comp.name), is_system);
+                    }
+                    if (collect_global_fragment && comp.global_fragment_prefix) {
+                        if (included) {
+                            task.global_fragment_includes.emplace_back(InternPath(*included));
+                        } else {
+                            collect_global_fragment = false;
+                        }
+                    }
                 } else {
                     // Interface of Header Unit
                     if (!comp.imported && comp.exported) {
                         if (use_backend_dependency_scan) {
                             produced_set[comp.name]--;
                         } else {
-                            task.produces.emplace_back(std::move(comp.name));
+                            task.produces.emplace_back(InternName(comp.name));
                         }
                     } else {
                         if (comp.type == Component::Type::HeaderUnit) {
@@ -445,9 +631,7 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
                                 Error("Source [{}] imports {}{}{} as header, but no header could be found",
                                     task.unique_name, comp.angled ? '<' : '"', comp.name, comp.angled ? '>' : '"');
                             }
-                            auto path = fs::absolute(*included);
-
-                            marked_header_units[path] = comp.name;
+                            marked_header_units[InternPath(*included)] = InternName(comp.name);
 
                             if (is_system) {
                                 // TODO: We should track these per source instead of per target
@@ -458,13 +642,15 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
                         if (use_backend_dependency_scan) {
                             required_set[comp.name]--;
                         } else {
-                            task.depends_on.emplace_back(Dependency{.name = std::move(comp.name)});
+                            task.depends_on.emplace_back(Dependency{.name = InternName(comp.name)});
                         }
                     }
                 }
             });
 
-            task.unique_name = scan_result.unique_name;
+            task.unique_name = state.arena.Store(scan_result.unique_name);
+            state.stats.files_scanned++;
+            state.stats.bytes_scanned += scan_result.size;
 
             if (use_backend_dependency_scan) {
                 for (auto&[r, s] : produced_set) {
@@ -494,10 +680,14 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
         }
     }
 
+    if (state.options.promote_header_units) {
+        PromoteHeaderUnits(state, task_includes, marked_header_units);
+    }
+
     LogDebug("Marking header units");
 
     for (auto& task : state.tasks) {
-        auto path = fs::absolute(task.source.path);
+        auto path = InternPath(task.source.path);
         auto iter = marked_header_units.find(path);
         if (iter == marked_header_units.end()) continue;
         task.is_header_unit = true;
@@ -511,9 +701,10 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
     LogDebug("Generating external header unit tasks");
 
     {
-        for (auto[path, logical_name] : marked_header_units) {
-            LogTrace("External header unit[{}] -> {}", path.string(), logical_name);
+        for (auto[path_id, logical_name] : marked_header_units) {
+            LogTrace("External header unit[{}] -> {}", path_id, logical_name);
 
+            auto& path = PathFromId(path_id);
             auto& task = state.tasks.emplace_back();
             task.source.path = path;
             // TODO: SHOULD ONLY DO THIS FOR SYSTEM HEADERS
@@ -521,14 +712,15 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
             //       We shouldn't depend on this for linking at all
             task.target = &state.targets.at("std");
             task.source.type = SourceType::CppHeader;
+            task.inputs = state.translation_inputs.Intern({ .type = SourceType::CppHeader });
             task.is_header_unit = true;
             task.produces.emplace_back(logical_name);
             task.external = true;
 
-            auto path_str = fs::absolute(path.string()).string();
+            auto path_str = path.string();
             auto hash = XXH64(path_str.data(), path_str.size(), 0);
 
-            task.unique_name = std::format("{}.{:x}", path.filename().string(), hash);
+            task.unique_name = state.arena.Store(std::format("{}.{:x}", path.filename().string(), hash));
         }
     }
 
@@ -542,17 +734,87 @@ void ScanDependencies(BuildState& state, bool use_backend_dependency_scan)
         return false;
     });
 }
+
+static
+size_t StringHeapBytes(const fs::path& path)
+{
+    auto& native = path.native();
+    using String = fs::path::string_type;
+    return native.capacity() > String().capacity() ? (native.capacity() + 1) * sizeof(String::value_type) : 0;
+}
+
+static
+size_t HeapBytes(const fs::path& path)
+{
+    auto bytes = StringHeapBytes(path);
+#ifdef __GLIBCXX__
+    // libstdc++ additionally keeps a heap list of all components of multi-component paths, each a full path object
+    // with its offset. This is most of the footprint of a typical absolute path (~400 bytes)
+    auto components = size_t(std::distance(path.begin(), path.end()));
+    if (components > 1) {
+        bytes += 2 * sizeof(int) + components * (sizeof(fs::path) + sizeof(size_t));
+        for (auto& component : path) bytes += StringHeapBytes(component);
+    }
+#endif
+    return bytes;
+}
+
+// Measured footprint of the task graph. Only unique names and reference lists live in the arena, source, BMI and
+// object paths are still separately allocated per task and dominate the total
+static
+void ReportTaskMemory(const BuildState& state)
+{
+    if (!IsLogLevel(LogLevel::Debug) || state.tasks.empty()) return;
+
+    size_t path_heap = 0;
+    size_t list_heap = 0;
+    for (auto& task : state.tasks) {
+        path_heap += HeapBytes(task.source.path) + HeapBytes(task.bmi) + HeapBytes(task.obj);
+        list_heap += task.produces.capacity() * sizeof(NameId);
+        list_heap += task.depends_on.capacity() * sizeof(Dependency);
+        list_heap += task.global_fragment_includes.capacity() * sizeof(PathId);
+    }
+
+    auto count = state.tasks.size();
+    auto inline_bytes = count * sizeof(Task);
+    auto arena_bytes = state.arena.BytesUsed();
+    LogDebug("Task graph memory: {} tasks, {}/task ({} inline, {} path heap, {} list heap, {} arena)",
+        count,
+        ByteSizeToString((inline_bytes + path_heap + list_heap + arena_bytes) / count),
+        ByteSizeToString(sizeof(Task)),
+        ByteSizeToString(path_heap / count),
+        ByteSizeToString(list_heap / count),
+        ByteSizeToString(arena_bytes / count));
+}
+
 void SortDependencies(BuildState& state)
 {
-    // TODO: Don't duplicate this, inefficient anyway!
-    auto FindTaskForProduced = [&](std::string_view name) -> Task* {
+    // All tasks exist by now, intern their sources once instead of on every lookup
+    for (auto& task : state.tasks) {
+        task.source_id = InternPath(task.source.path);
+    }
+
+    LogDebug("Resolving dependencies");
+
+    {
+        std::vector<uint32_t> producers(InternedNameCount(), InvalidTaskIndex);
+        for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+            for (auto produced : state.tasks[i].produces) {
+                auto& producer = producers[std::to_underlying(produced)];
+                if (producer == InvalidTaskIndex) producer = i;
+            }
+        }
+
         for (auto& task : state.tasks) {
-            for (auto& produced : task.produces) {
-                if (produced == name) return &task;
+            for (auto& dep : task.depends_on) {
+                auto producer = producers[std::to_underlying(dep.name)];
+                if (producer == InvalidTaskIndex) {
+                    Error(std::format("No task provides [{}] required by [{}]", dep.name, task.unique_name));
+                }
+                dep.source = producer;
             }
         }
-        return nullptr;
-    };
+    }
 
     LogDebug("Calculating dependency depths");
 
@@ -564,60 +826,40 @@ void SortDependencies(BuildState& state)
         task.max_depth = std::max(depth, task.max_depth);
 
         for (auto& dep : task.depends_on) {
-            auto source = FindTaskForProduced(dep.name);
-            if (!source) {
-                Error(std::format("No task provides [{}] required by [{}]", dep.name, task.unique_name));
-            }
-
-            self(*source, depth + 1);
+            self(state.tasks[dep.source], depth + 1);
         }
     };
 
-    {
-        // uint32_t max_depth  = 0;
-        for (auto& task : state.tasks) {
-            // max_depth = std::max(max_depth, FindMaxDepth(task));
-            FindMaxDepth(task, 1);
-        }
+    for (auto& task : state.tasks) {
+        FindMaxDepth(task, 1);
     }
 
-    // uint32_t i = 0;
-    // auto ReadMaxDepthChain = [&](this auto&& self, Task& task) -> void {
-    //     LogTrace("[{}] = {}", i++, task.source.path.string());
-    //
-    //     uint32_t max_depth = 0;
-    //     Task* max_task = nullptr;
-    //
-    //     for (auto& dep : task.depends_on) {
-    //         if (*dep.source->max_depth >= max_depth) {
-    //             max_depth = *dep.source->max_depth;
-    //             max_task = dep.source;
-    //         }
-    //     }
-    //
-    //     if (max_depth > 0) {
-    //         self(*max_task);
-    //     }
-    // };
-    //
-    // {
-    //     uint32_t max_depth = 0;
-    //     Task* max_task = nullptr;
-    //
-    //     for (auto& task : state.tasks) {
-    //         if (*task.max_depth >= max_depth) {
-    //             max_depth = *task.max_depth;
-    //             max_task = &task;
-    //         }
-    //     }
-    //
-    //     if (max_task) {
-    //         LogDebug("Maximum task depth = {}", max_depth);
-    //         ReadMaxDepthChain(*max_task);
-    //     }
-    // }
-
     LogDebug("Sorting tasks");
 
-    std::ranges::sort(state.tasks, [](auto& l, auto& r) { return l.max_depth > r.max_depth; });
+    state.order.resize(state.tasks.size());
+    std::iota(state.order.begin(), state.order.end(), 0u);
+    std::ranges::stable_sort(state.order, [&](uint32_t l, uint32_t r) {
+        return state.tasks[l].max_depth > state.tasks[r].max_depth;
+    });
+
+    LogDebug("Collecting transitive references");
+
+    // Dependencies are ordered before their dependents, so each closure is the union of the already complete
+    // closures of the direct dependencies
+    std::vector<uint32_t> references;
+    for (auto index : state.order) {
+        auto& task = state.tasks[index];
+        references.clear();
+        for (auto& dep : task.depends_on) {
+            references.emplace_back(dep.source);
+            auto& transitive = state.tasks[dep.source].references;
+            references.insert(references.end(), transitive.begin(), transitive.end());
+        }
+        std::ranges::sort(references);
+        auto duplicates = std::ranges::unique(references);
+        references.erase(duplicates.begin(), duplicates.end());
+        task.references = state.arena.StoreArray<uint32_t>(references);
+    }
+
+    ReportTaskMemory(state);
 }
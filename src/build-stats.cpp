@@ -0,0 +1,126 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <build.hpp>
+#include <json.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <algorithm>
+#endif
+
+static constexpr uint32_t SlowestTaskCount = 20;
+
+static
+double Seconds(chr::steady_clock::duration duration)
+{
+    return chr::duration<double>(duration).count();
+}
+
+void WriteBuildStats(const BuildState& state, const fs::path& path)
+{
+    auto& stats = state.stats;
+
+    LogInfo("Writing build statistics to [{}]", path.string());
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("version", 1);
+    json.Field("success", stats.success);
+
+    json.Key("phases").BeginArray();
+    for (auto&[name, duration] : stats.phases) {
+        json.BeginObject().Field("name", name).Field("seconds", Seconds(duration)).EndObject();
+    }
+    json.EndArray();
+
+    {
+        auto scan_seconds = Seconds(stats.scan_time);
+        json.Key("scan").BeginObject()
+            .Field("files", stats.files_scanned)
+            .Field("bytes", stats.bytes_scanned)
+            .Field("seconds", scan_seconds)
+            .Field("files_per_second", scan_seconds > 0 ? stats.files_scanned / scan_seconds : 0.0)
+            .Field("bytes_per_second", scan_seconds > 0 ? stats.bytes_scanned / scan_seconds : 0.0)
+            .EndObject();
+    }
+
+    {
+        auto total = stats.to_compile + stats.skipped;
+        json.Key("tasks").BeginObject()
+            .Field("total", total)
+            .Field("to_compile", stats.to_compile)
+            .Field("compiled", stats.compiled)
+            .Field("failed", stats.failed)
+            .Field("cache_hit_ratio", total ? double(stats.skipped) / total : 0.0);
+        json.Key("not_run").BeginObject()
+            .Field("up_to_date", stats.skipped)
+            .Field("blocked_by_failed_dependency", stats.blocked)
+            .EndObject();
+        json.EndObject();
+    }
+
+    {
+        auto busy = chr::steady_clock::duration{};
+        for (auto& record : stats.task_records) busy += record.end - record.start;
+        auto capacity = stats.compile_time * stats.max_threads;
+        auto idle = capacity > busy ? capacity - busy : chr::steady_clock::duration{};
+
+        json.Key("scheduler").BeginObject()
+            .Field("max_threads", stats.max_threads)
+            .Field("peak_concurrency", stats.peak_concurrency)
+            .Field("batches", stats.batches)
+            .Field("batch_fallbacks", stats.batch_fallbacks)
+            .Field("wall_seconds", Seconds(stats.compile_time))
+            .Field("busy_worker_seconds", Seconds(busy))
+            .Field("idle_worker_seconds", Seconds(idle))
+            .Field("utilization", capacity.count() ? Seconds(busy) / Seconds(capacity) : 0.0)
+            .EndObject();
+    }
+
+    {
+        std::vector<const TaskRecord*> slowest;
+        slowest.reserve(stats.task_records.size());
+        for (auto& record : stats.task_records) slowest.emplace_back(&record);
+        auto count = std::min<size_t>(SlowestTaskCount, slowest.size());
+        std::ranges::partial_sort(slowest, slowest.begin() + count, std::greater{}, [](auto* record) {
+            return record->end - record->start;
+        });
+
+        json.Key("slowest_tasks").BeginArray();
+        for (uint32_t i = 0; i < count; ++i) {
+            auto& record = *slowest[i];
+            auto& task = state.tasks[record.task];
+            json.BeginObject()
+                .Field("name", task.unique_name)
+                .Field("source", task.source.path.string())
+                .Field("target", task.target->name)
+                .Field("seconds", Seconds(record.end - record.start))
+                .Field("cpu_seconds", Seconds(task.usage.user_cpu + task.usage.system_cpu))
+                .Field("peak_memory", task.usage.peak_memory)
+                .Field("success", record.success)
+                .EndObject();
+        }
+        json.EndArray();
+    }
+
+    json.Key("links").BeginArray();
+    for (auto& record : stats.link_records) {
+        json.BeginObject()
+            .Field("name", record.name)
+            .Field("seconds", Seconds(record.usage.wall))
+            .Field("cpu_seconds", Seconds(record.usage.user_cpu + record.usage.system_cpu))
+            .Field("peak_memory", record.usage.peak_memory)
+            .Field("success", record.success)
+            .EndObject();
+    }
+    json.EndArray();
+
+    json.EndObject();
+
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path());
+    }
+    WriteStringToFile(path, json.out);
+}
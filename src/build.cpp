@@ -4,6 +4,7 @@ import std.compat;
 #endif
 
 #include "build.hpp"
+#include "trace.hpp"
 
 #ifndef HARMONY_USE_IMPORT_STD
 #include <print>
@@ -11,13 +12,17 @@ import std.compat;
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <thread>
 #include <fstream>
+#include <ranges>
 #endif
 
 #include <backend/backend.hpp>
+#include <json.hpp>
 
-// TODO: Move to generic logic
-#include <backend/msvc-common.hpp>
+#include <xxhash.h>
 
 void DetectAndInsertStdModules(BuildState& state)
 {
@@ -29,21 +34,25 @@ void DetectAndInsertStdModules(BuildState& state)
 
     auto& source_set = std_target.sources.emplace_back();
     source_set.inputs.type = SourceType::CppSource;
+    auto* std_inputs = state.translation_inputs.Intern(TranslationInputs(source_set.inputs));
+
+    auto std_name = InternName("std");
+    auto std_compat_name = InternName("std.compat");
 
     // TODO: Cleanup
     {
         std::optional<Task> std_task, std_compat_task;
         for (auto& task : state.tasks) {
             for (auto& depends_on : task.depends_on) {
-                if (depends_on.name == "std") {
+                if (depends_on.name == std_name) {
                     if (!std_task) {
                         LogDebug("Detected usage of [std] module");
                         std_task = Task {
                             .target = &std_target,
                             .source{.type = SourceType::CppInterface},
-                            .inputs = &source_set.inputs,
+                            .inputs = std_inputs,
                             .unique_name = "std",
-                            .produces = { "std" },
+                            .produces = { std_name },
                             .external = true,
                         };
                     }
@@ -51,16 +60,16 @@ void DetectAndInsertStdModules(BuildState& state)
                     task.target->imported_targets["std"] = DependencyType::Private;
                 }
 
-                if (depends_on.name == "std.compat") {
+                if (depends_on.name == std_compat_name) {
                     if (!std_compat_task) {
                         LogDebug("Detected usage of [std.compat] module");
                         std_compat_task = Task {
                             .target = &std_target,
                             .source{.type = SourceType::CppInterface},
-                            .inputs = &source_set.inputs,
+                            .inputs = std_inputs,
                             .unique_name = "std.compat",
-                            .produces = { "std.compat" },
-                            .depends_on = { {"std"} },
+                            .produces = { std_compat_name },
+                            .depends_on = { {std_name} },
                             .external = true,
                         };
                     }
@@ -92,61 +101,669 @@ void DetectAndInsertStdModules(BuildState& state)
     }
 }
 
-void Flatten(BuildState& state)
+void SplitModuleCompilation(BuildState& state)
+{
+    if (!state.backend->SplitsModuleCompilation()) return;
+
+    LogDebug("Splitting module interface compilation");
+
+    // Importers depend on the precompile task (which keeps the produced names), object generation is added as
+    // a separate task that depends on the interface's own BMI
+    auto count = uint32_t(state.tasks.size());
+    for (uint32_t i = 0; i < count; ++i) {
+        if (state.tasks[i].is_header_unit || state.tasks[i].produces.empty()) continue;
+
+        state.tasks[i].kind = TaskKind::Precompile;
+
+        Task codegen = state.tasks[i];
+        codegen.kind = TaskKind::Codegen;
+        codegen.depends_on = { Dependency{ .name = codegen.produces.front() } };
+        codegen.produces.clear();
+        state.tasks.emplace_back(std::move(codegen));
+    }
+
+    LogDebug("  Split {} module interfaces", state.tasks.size() - count);
+}
+
+// Shared libraries and all targets linked into them are compiled as position independent code
+static
+void ResolvePositionIndependence(BuildState& state)
 {
-    for (auto&[name, target] : state.targets) {
-        std::unordered_set<Target*> flattened;
-
-        [&](this auto&& self, Target& cur) -> void {
-            if (flattened.contains(&cur)) return;
-            if (&cur != &target) {
-                // Emplace if not self
-                flattened.emplace(&cur);
+    // Scanning may add imports (e.g. [std]), so closures computed during expansion must be refreshed
+    ResolveImportClosures(state);
+
+    for (auto&[_, target] : state.targets) {
+        if (!target.shared_library) continue;
+        if (!state.backend->SupportsSharedLibraries()) {
+            Error("Target [{}] is a shared library, which is not supported by the selected backend", target.name);
+        }
+        target.position_independent = true;
+        for (auto* imported : target.flattened_imports) {
+            imported->position_independent = true;
+        }
+    }
+}
+
+void GeneratePrecompiledHeaders(BuildState& state)
+{
+    if (!state.options.auto_pch) return;
+
+    // Prefixes are only needed to form groups
+    HARMONY_DEFER(&) {
+        for (auto& task : state.tasks) {
+            task.global_fragment_includes = {};
+        }
+    };
+
+    if (!state.backend->SupportsPrecompiledHeaders()) {
+        LogWarn("Backend does not support precompiled headers with modules, ignoring -auto-pch");
+        return;
+    }
+
+    LogDebug("Generating precompiled headers");
+
+    // A PCH is only accepted by units compiled with the same -fPIC setting, which must be known before grouping
+    ResolvePositionIndependence(state);
+
+    // Group module units by identical prefix, translation inputs and position independence, in task order to keep
+    // results deterministic
+
+    struct Group
+    {
+        uint64_t hash;
+        std::vector<uint32_t> tasks;
+    };
+    std::vector<Group> groups;
+    std::unordered_map<std::string, uint32_t> group_lookup;
+
+    std::string key;
+    for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+        auto& task = state.tasks[i];
+        if (task.global_fragment_includes.empty() || task.is_header_unit || task.kind == TaskKind::Codegen) continue;
+
+        key.assign(reinterpret_cast<const char*>(&task.inputs->hash), sizeof(task.inputs->hash));
+        key += char(task.target->position_independent);
+        key.append(reinterpret_cast<const char*>(task.global_fragment_includes.data()),
+            task.global_fragment_includes.size() * sizeof(PathId));
+
+        auto[iter, inserted] = group_lookup.emplace(key, uint32_t(groups.size()));
+        if (inserted) groups.emplace_back(XXH64(key.data(), key.size(), 0));
+        groups[iter->second].tasks.emplace_back(i);
+    }
+
+    // Only prefixes shared between units save work
+
+    static const fs::path PrecompiledHeaderDir = HarmonyTempDir / "pch";
+    fs::create_directories(PrecompiledHeaderDir);
+
+    uint32_t num_headers = 0;
+    uint32_t num_consumers = 0;
+    for (auto& group : groups) {
+        if (group.tasks.size() < 2) continue;
+
+        auto& first = state.tasks[group.tasks.front()];
+
+        // The newest include time is part of the contents, so the header (and with it the PCH and its consumers) is
+        // rebuilt when any header it includes, directly or transitively, changes
+        std::string contents = "// Generated by Harmony from a shared global module fragment prefix\n";
+        for (auto include : first.global_fragment_includes) {
+            contents += std::format("#include \"{}\"\n", FormatPath(PathFromId(include), PathFormatOptions::Forward | PathFormatOptions::Absolute));
+        }
+        auto newest = NewestIncludeTime(state, first.global_fragment_includes, first.inputs->include_dirs);
+        contents += std::format("// Newest input: {}\n", newest.time_since_epoch().count());
+
+        Task pch;
+        pch.target = first.target;
+        pch.source = { .path = PrecompiledHeaderDir / std::format("{:016x}.hpp", group.hash), .type = SourceType::CppHeader };
+        pch.inputs = first.inputs;
+        pch.kind = TaskKind::PrecompiledHeader;
+        pch.unique_name = state.arena.Store(std::format("pch.{:016x}", group.hash));
+
+        WriteFileIfChanged(pch.source.path, contents);
+
+        // Consumers find their PCH through an ordinary dependency, resolved like module names
+        auto name = InternName(pch.unique_name);
+        pch.produces.emplace_back(name);
+        for (auto index : group.tasks) {
+            state.tasks[index].depends_on.emplace_back(Dependency{ .name = name });
+        }
+
+        LogTrace("Precompiled header [{}] shared by {} units", pch.unique_name, group.tasks.size());
+        num_headers++;
+        num_consumers += uint32_t(group.tasks.size());
+
+        state.tasks.emplace_back(std::move(pch));
+    }
+
+    LogInfo("Precompiling {} shared global module fragment prefixes for {} module units", num_headers, num_consumers);
+}
+
+// Sources edited in this many separate builds within the window are compiled on their own, so that incremental
+// builds of files under active development don't recompile whole batches
+static constexpr uint32_t UnityIsolateEdits = 2;
+static constexpr chr::hours UnityIsolateWindow{24};
+
+struct EditHistoryEntry
+{
+    // Last seen modification time, only compared for equality
+    uint64_t write_time = 0;
+    // Builds (system time in seconds) in which the file was seen modified
+    std::vector<uint64_t> edits;
+};
+
+static
+std::unordered_map<std::string, EditHistoryEntry> LoadEditHistory(const fs::path& path)
+{
+    std::unordered_map<std::string, EditHistoryEntry> history;
+    if (!fs::exists(path)) return history;
+
+    auto contents = ReadFileToString(path);
+    JsonDocument doc(contents, std::nothrow);
+    if (!doc) {
+        LogWarn("Edit history [{}] is malformed, starting with an empty history", path.string());
+        return history;
+    }
+    for (auto[key, value] : doc.root()["files"].iter()) {
+        auto& entry = history[key];
+        entry.write_time = value["write_time"].uint64().value_or(0);
+        for (auto edit : value["edits"]) {
+            entry.edits.emplace_back(edit.uint64().value_or(0));
+        }
+    }
+
+    return history;
+}
+
+static
+void SaveEditHistory(const fs::path& path, const std::unordered_map<std::string, EditHistoryEntry>& history)
+{
+    std::vector<const std::pair<const std::string, EditHistoryEntry>*> sorted;
+    for (auto& entry : history) sorted.emplace_back(&entry);
+    std::ranges::sort(sorted, {}, [](auto* entry) -> const std::string& { return entry->first; });
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Key("files").BeginObject();
+    for (auto* entry : sorted) {
+        json.Key(entry->first).BeginObject();
+        json.Field("write_time", entry->second.write_time);
+        json.Key("edits").BeginArray();
+        for (auto edit : entry->second.edits) json.Number(edit);
+        json.EndArray();
+        json.EndObject();
+    }
+    json.EndObject();
+    json.EndObject();
+
+    fs::create_directories(path.parent_path());
+    WriteFileIfChanged(path, json.out);
+}
+
+void GenerateUnityBatches(BuildState& state)
+{
+    if (std::ranges::none_of(state.targets, [](auto& entry) { return entry.second.unity.has_value(); })) return;
+
+    LogDebug("Generating unity batches");
+
+    auto previous_history = LoadEditHistory(state.options.edit_history);
+    std::unordered_map<std::string, EditHistoryEntry> history;
+
+    auto now = uint64_t(chr::duration_cast<chr::seconds>(chr::system_clock::now().time_since_epoch()).count());
+    auto window_start = now - uint64_t(chr::seconds(UnityIsolateWindow).count());
+
+    // Only plain C++ sources without module dependencies can be concatenated, grouped by target and translation
+    // inputs in task order
+
+    struct Group
+    {
+        Target* target;
+        const InternedTranslationInputs* inputs;
+        std::vector<uint32_t> tasks;
+    };
+    std::vector<Group> groups;
+
+    uint32_t num_isolated = 0;
+    for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+        auto& task = state.tasks[i];
+        if (!task.target->unity || task.source.type != SourceType::CppSource) continue;
+        if (task.inputs->type != SourceType::Unknown && task.inputs->type != SourceType::CppSource) continue;
+        if (task.is_header_unit || task.kind != TaskKind::Compile || !task.produces.empty() || !task.depends_on.empty()) continue;
+
+        task.source_id = InternPath(task.source.path);
+        auto key = PathFromId(task.source_id).generic_string();
+        std::error_code ec;
+        auto write_time = uint64_t(fs::last_write_time(task.source.path, ec).time_since_epoch().count());
+
+        auto& entry = history[key];
+        entry.write_time = write_time;
+        if (auto iter = previous_history.find(key); iter != previous_history.end()) {
+            for (auto edit : iter->second.edits) {
+                if (edit >= window_start) entry.edits.emplace_back(edit);
             }
+            if (iter->second.write_time != write_time) entry.edits.emplace_back(now);
+        }
+
+        if (entry.edits.size() >= UnityIsolateEdits) {
+            LogTrace("Source [{}] edited in {} recent builds, excluding from unity batches", key, entry.edits.size());
+            num_isolated++;
+            continue;
+        }
+
+        auto iter = std::ranges::find_if(groups, [&](const Group& group) {
+            return group.target == task.target && group.inputs == task.inputs;
+        });
+        if (iter == groups.end()) iter = groups.emplace(groups.end(), task.target, task.inputs);
+        iter->tasks.emplace_back(i);
+    }
+
+    SaveEditHistory(state.options.edit_history, history);
+
+    // Batches are runs of sources in path order, ending after any source whose path hash is divisible by the batch
+    // size. Boundaries only depend on the paths themselves, so adding, removing or isolating a source only changes
+    // the batches up to the next boundary. Runs are also cut once they reach the batch size
+
+    static const fs::path UnityDir = HarmonyTempDir / "unity";
+    fs::create_directories(UnityDir);
+
+    std::vector<Task> batches;
+    std::vector<bool> batched(state.tasks.size());
+    std::unordered_set<fs::path> emitted;
+    uint32_t num_batched = 0;
+
+    auto EmitBatch = [&](const Group& group, std::span<const uint32_t> members) {
+        std::string contents = std::format("// Generated by Harmony, unity batch of target [{}]\n", group.target->name);
+        fs::file_time_type newest{};
+        auto hash = group.inputs->hash;
+        for (auto index : members) {
+            auto& path = state.tasks[index].source.path;
+            auto path_str = FormatPath(path, PathFormatOptions::Forward | PathFormatOptions::Absolute);
+            contents += std::format("#include \"{}\"\n", path_str);
+            hash = XXH64(path_str.data(), path_str.size(), hash);
+            std::error_code ec;
+            newest = std::max(newest, fs::last_write_time(path, ec));
+            batched[index] = true;
+        }
+        // As with precompiled headers, the newest member time makes the batch out of date when any member changes
+        contents += std::format("// Newest input: {}\n", newest.time_since_epoch().count());
+
+        auto& batch = batches.emplace_back();
+        batch.target = group.target;
+        batch.source = { .path = UnityDir / std::format("{}.{:016x}.cpp", group.target->name, hash), .type = SourceType::CppSource };
+        batch.inputs = group.inputs;
+        batch.unique_name = state.arena.Store(std::format("unity.{:016x}", hash));
+        batch.unity_batch = true;
+
+        WriteFileIfChanged(batch.source.path, contents);
+        emitted.emplace(batch.source.path);
+
+        LogTrace("Unity batch [{}] with {} sources", batch.unique_name, members.size());
+        num_batched += uint32_t(members.size());
+    };
+
+    for (auto& group : groups) {
+        std::ranges::sort(group.tasks, {}, [&](uint32_t index) -> auto& { return state.tasks[index].source.path; });
+
+        auto batch_size = group.target->unity->batch_size;
+        size_t begin = 0;
+        for (size_t i = 0; i < group.tasks.size(); ++i) {
+            auto path_str = PathFromId(state.tasks[group.tasks[i]].source_id).generic_string();
+            bool boundary = XXH64(path_str.data(), path_str.size(), 0) % batch_size == 0;
+            if (!boundary && i + 1 - begin < batch_size && i + 1 < group.tasks.size()) continue;
+
+            auto members = std::span(group.tasks).subspan(begin, i + 1 - begin);
+            if (members.size() >= 2) EmitBatch(group, members);
+            begin = i + 1;
+        }
+    }
+
+    // Batches of unity targets in this build that were not emitted again are stale. The directory is shared between
+    // projects, so batches of other targets are left alone
+
+    uint32_t num_pruned = 0;
+    for (auto& entry : fs::directory_iterator(UnityDir)) {
+        auto& path = entry.path();
+        if (path.extension() != ".cpp" || emitted.contains(path)) continue;
+        auto iter = state.targets.find(path.stem().stem().string());
+        if (iter == state.targets.end() || !iter->second.unity) continue;
+        std::error_code ec;
+        if (fs::remove(path, ec)) num_pruned++;
+    }
+    if (num_pruned) LogDebug("  Removed {} stale unity batches", num_pruned);
+
+    // Batched sources are kept for tools that need per-source information, such as compile commands
+
+    std::vector<Task> tasks;
+    tasks.reserve(state.tasks.size() - num_batched + batches.size());
+    for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+        if (batched[i]) {
+            state.unity_sources.emplace_back(std::move(state.tasks[i]));
+        } else {
+            tasks.emplace_back(std::move(state.tasks[i]));
+        }
+    }
+    std::ranges::move(batches, std::back_inserter(tasks));
+    state.tasks = std::move(tasks);
 
-            for (auto&[import_name, type] : cur.imported_targets) {
-                // TODO: link vs source imports need to be handled separately
-                LogTrace("  importing from [{}]", import_name);
-                try {
-                    auto& imported = state.targets.at(import_name);
+    LogInfo("Batched {} sources into {} unity translation units ({} frequently edited sources excluded)",
+        num_batched, batches.size(), num_isolated);
+}
 
-                    self(imported);
-                } catch (std::exception& e) {
-                    Error(e.what());
+void Flatten(BuildState& state)
+{
+    ResolvePositionIndependence(state);
+}
+
+#ifdef _WIN32
+static constexpr std::string_view LinkExtension = ".lib";
+static constexpr std::string_view SharedExtension = ".dll";
+#else
+static constexpr std::string_view LinkExtension = ".a";
+static constexpr std::string_view SharedExtension = ".so";
+#endif
+
+// Visit files (or matching files in directories) listed by a target and all of its flattened imports
+static
+void ForEachTargetFile(const Target& target, std::vector<fs::path> Target::* files, std::string_view extension,
+    std::string_view kind, function_ref<void(const fs::path&)> callback)
+{
+    auto AddFiles = [&](const Target& t) {
+        LogTrace("Adding {} for: [{}]", kind, t.name);
+        for (auto& file : t.*files) {
+            if (fs::is_regular_file(file)) {
+                LogTrace("    adding: [{}]", file.string());
+                callback(file);
+            } else if (fs::is_directory(file)) {
+                LogTrace("  finding {} in: [{}]", kind, file.string());
+                for (auto iter : fs::directory_iterator(file)) {
+                    auto path = iter.path();
+                    if (path.extension() == extension) {
+                        LogTrace("    adding: [{}]", path.string());
+                        callback(path);
+                    }
                 }
+            } else {
+                LogWarn("{} path not found: [{}]", kind, file.string());
             }
-        }(target);
+        }
+    };
+    AddFiles(target);
+    for (auto* import_target : target.flattened_imports) {
+        AddFiles(*import_target);
+    }
+}
 
-        target.flattened_imports = std::move(flattened);
+void ForEachLink(const Target& target, function_ref<void(const fs::path&)> callback)
+{
+    ForEachTargetFile(target, &Target::links, LinkExtension, "links", callback);
+}
+
+void ForEachShared(const Target& target, function_ref<void(const fs::path&)> callback)
+{
+    ForEachTargetFile(target, &Target::shared, SharedExtension, "shared libraries", callback);
+    for (auto* imported : target.flattened_imports) {
+        if (imported->shared_library && imported->shared_library->built_path) {
+            callback(*imported->shared_library->built_path);
+        }
     }
 }
 
-bool Build(BuildState& state, bool multithreaded)
+std::string BuildLogKey(const Task& task)
 {
-    LogInfo("Building");
+    std::string_view kind = "compile";
+    if (task.kind == TaskKind::Precompile) kind = "precompile";
+    else if (task.kind == TaskKind::Codegen) kind = "codegen";
+    else if (task.kind == TaskKind::PrecompiledHeader) kind = "pch";
+    auto source_id = (task.source_id != PathId::Invalid) ? task.source_id : InternPath(task.source.path);
+    return std::format("{}:{}", kind, PathFromId(source_id).generic_string());
+}
 
-    LogDebug("Resolving dependencies");
+std::string BuildLogKey(const Target& target)
+{
+    return std::format("link:{}", target.name);
+}
 
-    {
-        // TODO: We should handle this per target, unbuilt targets may remain unexpanded and only contain
-        //       output information
-        auto FindTaskForProduced = [&](std::string_view name) -> Task* {
-            for (auto& task : state.tasks) {
-                for (auto& produced : task.produces) {
-                    if (produced == name) return &task;
+std::string BuildLogArchiveKey(const Target& target)
+{
+    return std::format("archive:{}", target.name);
+}
+
+// Hash of everything besides the source that affects a task's output, recorded in the build log. Position
+// independence is decided per target in Flatten, so it isn't part of the interned translation inputs
+static
+uint64_t TaskInputsHash(const Task& task)
+{
+    if (!task.inputs) return 0;
+    auto hash = task.inputs->hash;
+    if (task.target->position_independent) hash = XXH64("pic", 3, hash);
+    return hash;
+}
+
+static
+BuildLogInputs RecordedTaskInputs(const Task& task)
+{
+    BuildLogInputs recorded;
+    recorded.type = uint8_t(std::to_underlying(task.inputs->type));
+    recorded.defines = task.inputs->defines;
+    for (auto& include_dir : task.inputs->include_dirs) recorded.include_dirs.emplace_back(include_dir.generic_string());
+    for (auto& force_include : task.inputs->force_includes) recorded.force_includes.emplace_back(force_include.generic_string());
+    recorded.position_independent = task.target->position_independent;
+    return recorded;
+}
+
+// Differences between the inputs of the last compile and the current ones, e.g. "define [FOO=1] added"
+static
+std::string DescribeInputsChange(const BuildLogInputs& previous, const BuildLogInputs& current)
+{
+    std::vector<std::string> changes;
+
+    if (previous.type != current.type) {
+        changes.emplace_back(std::format("source type [{}] -> [{}]",
+            SourceTypeToString(SourceType(previous.type)), SourceTypeToString(SourceType(current.type))));
+    }
+
+    auto Compare = [&](std::string_view kind, const std::vector<std::string>& before, const std::vector<std::string>& after) {
+        auto count = changes.size();
+        for (auto& value : after) {
+            if (!std::ranges::contains(before, value)) changes.emplace_back(std::format("{} [{}] added", kind, value));
+        }
+        for (auto& value : before) {
+            if (!std::ranges::contains(after, value)) changes.emplace_back(std::format("{} [{}] removed", kind, value));
+        }
+        if (changes.size() == count && before != after) changes.emplace_back(std::format("{} order changed", kind));
+    };
+    Compare("define", previous.defines, current.defines);
+    Compare("include dir", previous.include_dirs, current.include_dirs);
+    Compare("force include", previous.force_includes, current.force_includes);
+
+    if (previous.position_independent != current.position_independent) {
+        changes.emplace_back(current.position_independent ? "now position independent" : "no longer position independent");
+    }
+
+    std::string out;
+    for (auto& change : changes) {
+        if (!out.empty()) out += ", ";
+        out += change;
+    }
+    return out;
+}
+
+static
+std::string DescribeDirtyTask(BuildState& state, const Task& task)
+{
+    switch (task.dirty_reason) {
+        case DirtyReason::MissingOutput:
+            return std::format("output [{}] does not exist", task.PrimaryOutput().string());
+        case DirtyReason::SourceChanged:
+            return std::format("source [{}] is newer than its output", task.source.path.string());
+        case DirtyReason::InputsChanged:
+            // Inputs are only known for compiles recorded since they were added to the build log
+            if (auto entry = state.build_log.Find(BuildLogKey(task))) {
+                if (auto previous = state.build_log.FindInputs(entry->inputs_hash)) {
+                    return std::format("translation inputs of [{}] changed: {}",
+                        task.target->name, DescribeInputsChange(*previous, RecordedTaskInputs(task)));
                 }
             }
-            return nullptr;
-        };
+            return std::format("translation inputs of [{}] changed (defines, include dirs, force includes or position independence)", task.target->name);
+        default:
+            return std::string(DirtyReasonToString(task.dirty_reason));
+    }
+}
 
-        for (auto& task : state.tasks) {
-            for (auto& depends_on : task.depends_on) {
-                auto* depends_on_task = FindTaskForProduced(depends_on.name);
-                // All dependencies guaranteed to be satisfied from build scan dependencies phase
-                depends_on.source = depends_on_task;
-            }
+static
+void ExplainRebuilds(BuildState& state)
+{
+    auto RootCause = [&](uint32_t index) {
+        while (state.tasks[index].dirty_reason == DirtyReason::DependencyChanged) {
+            index = state.tasks[index].dirty_cause;
+        }
+        return index;
+    };
+
+    std::unordered_map<uint32_t, uint32_t> root_counts;
+
+    LogInfo("Explaining rebuilds:");
+    for (auto index : state.order) {
+        auto& task = state.tasks[index];
+        if (task.dirty_reason == DirtyReason::None) continue;
+
+        root_counts[RootCause(index)]++;
+
+        LogInfo("  [{}] {}", task.unique_name, DescribeDirtyTask(state, task));
+
+        // Walk the chain of dirty dependencies back to the task that was changed directly
+        for (auto* cur = &task; cur->dirty_reason == DirtyReason::DependencyChanged;) {
+            auto& cause = state.tasks[cur->dirty_cause];
+            auto dep = std::ranges::find(cur->depends_on, cur->dirty_cause, &Dependency::source);
+            LogInfo("    <- imports [{}] from [{}]{}", dep->name, cause.unique_name,
+                cause.dirty_reason == DirtyReason::DependencyChanged ? "" : std::format(": {}", DescribeDirtyTask(state, cause)));
+            cur = &cause;
+        }
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> roots(root_counts.begin(), root_counts.end());
+    std::ranges::sort(roots, std::greater{}, [](auto& root) { return std::pair(root.second, ~root.first); });
+
+    if (roots.empty()) {
+        LogInfo("  Nothing to rebuild");
+        return;
+    }
+
+    LogInfo("Top root causes:");
+    for (auto[index, count] : roots | std::views::take(10)) {
+        auto& task = state.tasks[index];
+        LogInfo("  {:>5} task(s) <- [{}] {}", count, task.unique_name, DescribeDirtyTask(state, task));
+    }
+}
+
+// Tasks that can be handed to Backend::CompileTaskBatch, plain sources without any module or header dependencies
+static
+bool IsBatchable(const Task& task)
+{
+    if (task.kind != TaskKind::Compile || task.is_header_unit || !task.produces.empty() || !task.depends_on.empty()) return false;
+    auto type = (task.inputs->type == SourceType::Unknown) ? task.source.type : task.inputs->type;
+    return type == SourceType::CSource || type == SourceType::CppSource;
+}
+
+static
+bool IsSameBatch(const Task& a, const Task& b)
+{
+    // Interned inputs compare by pointer, the source type decides the language flags
+    return a.target == b.target && a.inputs == b.inputs && a.source.type == b.source.type;
+}
+
+// Identity of a set of link or archive inputs, recorded in the build log to detect added and removed inputs
+static
+uint64_t HashPaths(std::vector<fs::path>& paths)
+{
+    std::ranges::sort(paths);
+    uint64_t hash = 0;
+    for (auto& path : paths) {
+        auto str = path.generic_string();
+        hash = XXH64(str.c_str(), str.size() + 1, hash);
+    }
+    return hash;
+}
+
+static
+bool IsNewerThanAll(const fs::path& output, std::span<const fs::path> inputs)
+{
+    std::error_code ec;
+    auto output_time = fs::last_write_time(output, ec);
+    if (ec) return false;
+    return std::ranges::none_of(inputs, [&](auto& input) { return fs::last_write_time(input, ec) > output_time || ec; });
+}
+
+// Create or update the static library of a target that isn't an executable. Members are only replaced while the
+// set of members is unchanged, otherwise the library is rebuilt so that removed objects don't linger
+static
+bool ArchiveTarget(BuildState& state, const Target& target)
+{
+    std::vector<fs::path> objects;
+    ForEachObject(*state.backend, target, state.tasks, [&](const fs::path& obj) { objects.emplace_back(obj); });
+    if (objects.empty()) return true;
+
+    auto archive = state.backend->ArchivePath(target);
+    auto members_hash = HashPaths(objects);
+
+    std::vector<fs::path> changed;
+    bool update = false;
+    if (auto entry = state.build_log.Find(BuildLogArchiveKey(target));
+            entry && entry->inputs_hash == members_hash && fs::exists(archive)) {
+        auto archive_time = fs::last_write_time(archive);
+        for (auto& obj : objects) {
+            if (fs::last_write_time(obj) > archive_time) changed.emplace_back(obj);
+        }
+        if (changed.empty()) {
+            LogDebug("Archive [{}] is up to date", archive.string());
+            return true;
         }
+        update = true;
+    } else {
+        std::error_code ec;
+        fs::remove(archive, ec);
+    }
+
+    auto& members = update ? changed : objects;
+    LogInfo("Archiving [{}] ({} of {} objects)", target.name, members.size(), objects.size());
+
+    auto start = chr::steady_clock::now();
+    bool res;
+    ResourceUsage usage;
+    {
+        ResourceAccountingScope accounting;
+        res = state.backend->ArchiveStep(target, members, update);
+        usage = accounting.Usage();
+    }
+    TraceEvent(archive.filename().string(), res ? "archive" : "archive (failed)", start, chr::steady_clock::now());
+    state.stats.link_records.emplace_back(archive.filename().string(), usage, res);
+
+    if (res) {
+        state.build_log.Record(BuildLogArchiveKey(target), usage, members_hash);
+    } else {
+        LogError("Error archiving [{}]", target.name);
     }
+    return res;
+}
+
+static constexpr chr::milliseconds ProgressRefreshInterval{100};
+
+// Exported interface of a shared library target, recorded as the inputs hash of the last link
+static
+std::string BuildLogInterfaceKey(const Target& target)
+{
+    return std::format("interface:{}", target.name);
+}
+
+bool Build(BuildState& state)
+{
+    LogInfo("Building");
+
+    state.build_log.Load(state.options.build_log);
+    HARMONY_DEFER(&) { state.build_log.Save(state.options.build_log); };
+
+    // Dependencies are resolved to task indices in SortDependencies
+    // TODO: We should handle this per target, unbuilt targets may remain unexpanded and only contain
+    //       output information
 
     // TODO: Check for illegal cycles (both in modules and includes)
 
@@ -158,19 +775,27 @@ bool Build(BuildState& state, bool multithreaded)
 
     // Filter on immediate file changes
 
-    for (auto& task : state.tasks) {
+    for (uint32_t i = 0; i < state.tasks.size(); ++i) {
+        auto& task = state.tasks[i];
         // TODO: Filter for *all* tasks unless -clean specified
         // if (!task.external) continue;
         // if (task.target->name == "panta-rhei" || task.target->name == "propolis") continue;
 
-        if (task.is_header_unit) {
-            if (!fs::exists(task.bmi) || fs::last_write_time(task.source.path) > fs::last_write_time(task.bmi)) {
-                continue;
-            }
-        } else {
-            if (!fs::exists(task.obj) || fs::last_write_time(task.source.path) > fs::last_write_time(task.obj)) {
-                continue;
-            }
+        auto& output = task.PrimaryOutput();
+        if (!fs::exists(output)) {
+            task.dirty_reason = DirtyReason::MissingOutput;
+            continue;
+        }
+        if (fs::last_write_time(task.source.path) > fs::last_write_time(output)) {
+            task.dirty_reason = DirtyReason::SourceChanged;
+            continue;
+        }
+
+        // Outputs from a build with different defines/includes are stale even if they are newer than the source
+        if (auto entry = state.build_log.Find(BuildLogKey(task));
+                entry && entry->inputs_hash && task.inputs && entry->inputs_hash != TaskInputsHash(task)) {
+            task.dirty_reason = DirtyReason::InputsChanged;
+            continue;
         }
 
         task.state = TaskState::Complete;
@@ -179,25 +804,29 @@ bool Build(BuildState& state, bool multithreaded)
     // Filter on dependent module changes
 
     {
-        std::unordered_map<void*, bool> cache;
-        auto CheckForUpdateRequired = [&](this auto&& self, Task& task) {
-            if (cache.contains(&task)) {
-                return cache.at(&task);
+        enum class UpdateRequired : uint8_t { Unknown, Yes, No };
+        std::vector<UpdateRequired> cache(state.tasks.size(), UpdateRequired::Unknown);
+        auto CheckForUpdateRequired = [&](this auto&& self, Task& task) -> bool {
+            auto& cached = cache[&task - state.tasks.data()];
+            if (cached != UpdateRequired::Unknown) {
+                return cached == UpdateRequired::Yes;
             }
             if (task.state != TaskState::Complete) {
-                cache[&task] = true;
+                cached = UpdateRequired::Yes;
                 return true;
             }
 
             for (auto& dep : task.depends_on) {
-                if (self(*dep.source)) {
+                if (self(state.tasks[dep.source])) {
                     task.state = TaskState::Waiting;
-                    cache[&task] = true;
+                    task.dirty_reason = DirtyReason::DependencyChanged;
+                    task.dirty_cause = dep.source;
+                    cached = UpdateRequired::Yes;
                     return true;
                 }
             }
 
-            cache[&task] = false;
+            cached = UpdateRequired::No;
             return false;
         };
 
@@ -208,14 +837,20 @@ bool Build(BuildState& state, bool multithreaded)
 
     // TODO: Filter on included header changes
 
+    // Inputs are kept alongside their hash, so that -explain can name what changed in a later build
+    for (auto& task : state.tasks) {
+        if (!task.inputs) continue;
+        auto hash = TaskInputsHash(task);
+        if (!state.build_log.HasInputs(hash)) state.build_log.RecordInputs(hash, RecordedTaskInputs(task));
+    }
+
+    if (state.options.explain) {
+        ExplainRebuilds(state);
+    }
+
     LogDebug("Executing build steps");
 
-    struct CompileStats {
-        uint32_t to_compile = 0;
-        uint32_t skipped = 0;
-        uint32_t compiled = 0;
-        uint32_t failed = 0;
-    } stats;
+    auto& stats = state.stats;
 
     // Record num of skipped tasks for build stats
     for (auto& task : state.tasks) {
@@ -223,21 +858,32 @@ bool Build(BuildState& state, bool multithreaded)
         else if (task.state == TaskState::Waiting) stats.to_compile++;
     }
 
-    // if (true) {
-    //     backend.GenerateCompileCommands(tasks);
-    //     return;
-    // }
-
     LogInfo("Compiling {} files ({} up to date)", stats.to_compile, stats.skipped);
 
     auto start = chr::steady_clock::now();
 
     {
         std::mutex m;
+        std::vector<bool> busy_lanes;
         std::atomic_uint32_t num_started = 0;
         std::atomic_uint32_t num_complete = 0;
         uint32_t last_num_complete = 0;
         uint32_t max_threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        stats.max_threads = state.options.multithreaded ? max_threads : 1;
+        auto max_batch_size = state.backend->MaxCompileBatchSize();
+        BuildProgress progress(state);
+
+        // The scheduler only wakes when a task completes, refresh the status line and ETA during long compilations
+        std::jthread progress_ticker;
+        if (progress.enabled && progress.terminal) {
+            progress_ticker = std::jthread([&](std::stop_token stop) {
+                std::condition_variable_any cv;
+                std::unique_lock lock{m};
+                while (!cv.wait_for(lock, stop, ProgressRefreshInterval, [] { return false; }) && !stop.stop_requested()) {
+                    progress.Update();
+                }
+            });
+        }
 
         // bool abort = false;
 
@@ -257,7 +903,19 @@ bool Build(BuildState& state, bool multithreaded)
             }
             last_num_complete = _num_complete;
 
-            for (auto& task : state.tasks) {
+            std::vector<std::vector<uint32_t>> ready_batches;
+            if (max_batch_size > 1) {
+                for (auto index : state.order) {
+                    auto& task = state.tasks[index];
+                    if (std::atomic_ref(task.state).load() != TaskState::Waiting || !IsBatchable(task)) continue;
+                    auto group = std::ranges::find_if(ready_batches, [&](auto& ready) { return IsSameBatch(state.tasks[ready.front()], task); });
+                    if (group == ready_batches.end()) group = ready_batches.emplace(ready_batches.end());
+                    group->emplace_back(index);
+                }
+            }
+
+            for (auto index : state.order) {
+                auto& task = state.tasks[index];
                 auto cur_state = std::atomic_ref(task.state).load();
                 if (cur_state == TaskState::Complete || cur_state == TaskState::Failed) continue;
 
@@ -267,27 +925,101 @@ bool Build(BuildState& state, bool multithreaded)
 
                 if (!std::ranges::all_of(task.depends_on,
                         [&](auto& dependency) {
-                            return std::atomic_ref(dependency.source->state) == TaskState::Complete;
+                            return std::atomic_ref(state.tasks[dependency.source].state) == TaskState::Complete;
                         })) {
                     continue;
                 }
 
+                // Ready tasks that can share a compiler invocation are only grouped as far as needed to keep all
+                // threads busy
+                std::vector<uint32_t> batch{ index };
+                if (max_batch_size > 1 && IsBatchable(task)) {
+                    auto& group = *std::ranges::find_if(ready_batches, [&](auto& ready) { return IsSameBatch(state.tasks[ready.front()], task); });
+                    auto size = std::clamp(uint32_t((group.size() + max_threads - 1) / max_threads), 1u, max_batch_size);
+                    for (auto other : group) {
+                        if (batch.size() >= size) break;
+                        if (other != index && std::atomic_ref(state.tasks[other].state).load() == TaskState::Waiting) batch.emplace_back(other);
+                    }
+                }
+
                 num_started++;
                 launched++;
 
-                task.state = TaskState::Compiling;
-                auto DoCompile = [&state, &task, &num_complete] {
-                    auto success = state.backend->CompileTask(task);
+                {
+                    std::scoped_lock lock{m};
+                    for (auto member : batch) {
+                        std::atomic_ref(state.tasks[member].state) = TaskState::Compiling;
+                        progress.Started(member);
+                    }
+                }
+                auto DoCompile = [&state, &stats, &num_complete, &m, &busy_lanes, batch = std::move(batch)] {
+                    // Assign a stable worker lane for tracing
+                    uint32_t lane;
+                    {
+                        std::scoped_lock lock{m};
+                        lane = uint32_t(std::ranges::find(busy_lanes, false) - busy_lanes.begin());
+                        if (lane == busy_lanes.size()) busy_lanes.emplace_back();
+                        busy_lanes[lane] = true;
+                        stats.peak_concurrency = std::max(stats.peak_concurrency, uint32_t(std::ranges::count(busy_lanes, true)));
+                    }
+                    TraceLaneName(lane + 1, std::format("worker {}", lane + 1));
+
+                    auto task_start = chr::steady_clock::now();
+                    std::vector<bool> results;
+                    ResourceUsage usage;
+                    {
+                        ResourceAccountingScope accounting;
+                        if (batch.size() == 1) {
+                            results = { state.backend->CompileTask(state.tasks[batch.front()], state.tasks) };
+                        } else {
+                            results = state.backend->CompileTaskBatch(batch, state.tasks);
+                        }
+                        usage = accounting.Usage();
+                    }
+                    auto task_end = chr::steady_clock::now();
+
+                    // A batch that needed more than one process was retried per task, and saved nothing
+                    bool fell_back = batch.size() > 1 && usage.processes > 1;
+
+                    // Usage of a shared invocation is split evenly between its tasks
+                    auto count = uint32_t(batch.size());
+                    usage.wall /= count;
+                    usage.user_cpu /= count;
+                    usage.system_cpu /= count;
+                    usage.io_read /= count;
+                    usage.io_write /= count;
+
+                    for (uint32_t i = 0; i < count; ++i) {
+                        auto& task = state.tasks[batch[i]];
+                        task.usage = usage;
+                        if (results[i]) {
+                            state.build_log.Record(BuildLogKey(task), task.usage, TaskInputsHash(task));
+                        }
+                        TraceEvent(task.unique_name, results[i] ? "compile" : "compile (failed)",
+                            task_start, task_end, lane + 1, task.source.path.string());
+                    }
+
+                    {
+                        std::scoped_lock lock{m};
+                        busy_lanes[lane] = false;
+                        if (count > 1) stats.batches++;
+                        if (fell_back) stats.batch_fallbacks++;
+                        for (uint32_t i = 0; i < count; ++i) {
+                            stats.task_records.emplace_back(batch[i], task_start, task_end, results[i]);
+                        }
+                    }
 
-                    std::atomic_ref(task.state) = success ? TaskState::Complete : TaskState::Failed;
+                    for (uint32_t i = 0; i < count; ++i) {
+                        std::atomic_ref(state.tasks[batch[i]].state) = results[i] ? TaskState::Complete : TaskState::Failed;
+                    }
 
                     num_complete++;
                     num_complete.notify_all();
 
-                    return success;
+                    return std::ranges::all_of(results, std::identity{});
                 };
 
-                if (multithreaded) {
+                if (state.options.multithreaded) {
                     std::thread t{DoCompile};
                     t.detach();
                 } else {
@@ -301,6 +1033,11 @@ bool Build(BuildState& state, bool multithreaded)
                 }
             }
 
+            {
+                std::scoped_lock lock{m};
+                progress.Update();
+            }
+
             // if (abort) {
             //     break;
             // }
@@ -322,8 +1059,9 @@ bool Build(BuildState& state, bool multithreaded)
                     if (task.state == TaskState::Complete) continue;
                     LogError("task[{}] blocked", task.source.path.string());
                     for (auto& dep : task.depends_on) {
-                        if (dep.source->state == TaskState::Complete) continue;
-                        LogError(" - {}{}", dep.name, dep.source->state == TaskState::Failed ? " (failed)" : "");
+                        auto& source = state.tasks[dep.source];
+                        if (source.state == TaskState::Complete) continue;
+                        LogError(" - {}{}", dep.name, source.state == TaskState::Failed ? " (failed)" : "");
                     }
                 }
                 break;
@@ -336,6 +1074,7 @@ bool Build(BuildState& state, bool multithreaded)
     }
 
     auto end = chr::steady_clock::now();
+    stats.compile_time = end - start;
 
     LogInfo("Reporting Build Stats");
 
@@ -353,34 +1092,120 @@ bool Build(BuildState& state, bool multithreaded)
             LogInfo("Compiled = {} / {}", stats.compiled, stats.to_compile);
         }
         if (stats.failed)  LogWarn("  Failed  = {}", stats.failed);
-        if (stats.compiled < stats.to_compile) LogWarn("  Blocked = {}", stats.to_compile - (stats.compiled + stats.failed));
+        stats.blocked = stats.to_compile - (stats.compiled + stats.failed);
+        if (stats.blocked) LogWarn("  Blocked = {}", stats.blocked);
+        if (stats.batch_fallbacks) LogWarn("  {} / {} batches were compiled per task", stats.batch_fallbacks, stats.batches);
         LogInfo("Elapsed  = {}", DurationToString(end - start));
 
     }
 
     if (stats.compiled != stats.to_compile) return false;
 
-    LogInfo("Creating target executables");
+    TraceScope link_scope("link");
 
     int link_errors = 0;
 
+    LogDebug("Archiving library targets");
+
     for (auto&[_, target] : state.targets) {
-        if (!target.executable) continue;
+        if (target.executable || target.shared_library) continue;
+        if (!ArchiveTarget(state, target)) link_errors++;
+    }
 
-        LogInfo("Linking [{}] from [{}]", target.executable->name, target.name);
-        auto res = state.backend->LinkStep(target, state.tasks);
-        if (!res) {
-            LogError("Error linking [{}] from [{}]", target.executable->name, target.name);
-            link_errors++;
-            continue;
+    if (link_errors) return false;
+
+    LogInfo("Creating target executables and shared libraries");
+
+    // Shared libraries are linked before their importers. Imports have strictly fewer flattened imports than
+    // their importers, so ordering by that count is a valid dependency order
+
+    std::vector<Target*> linked_targets;
+    for (auto&[_, target] : state.targets) {
+        if (target.executable || target.shared_library) linked_targets.emplace_back(&target);
+    }
+    std::ranges::sort(linked_targets, [](const Target* l, const Target* r) {
+        if (bool(l->executable) != bool(r->executable)) return !l->executable;
+        if (l->flattened_imports.size() != r->flattened_imports.size()) return l->flattened_imports.size() < r->flattened_imports.size();
+        return l->name < r->name;
+    });
+
+    for (auto* linked_target : linked_targets) {
+        auto& target = *linked_target;
+        auto& name = target.executable ? target.executable->name : target.shared_library->name;
+        auto& built_path = target.executable ? target.executable->built_path : target.shared_library->built_path;
+
+        // Targets are only relinked when an input changed, or inputs were added or removed. Imported shared libraries
+        // with a known interface only count through that interface, so implementation changes don't cause relinks
+
+        std::vector<fs::path> link_inputs;
+        std::vector<std::pair<fs::path, uint64_t>> interfaces;
+        auto AddLinkInput = [&](const fs::path& path) { link_inputs.emplace_back(path); };
+        ForEachObject(*state.backend, target, state.tasks, AddLinkInput);
+        ForEachImportedLibrary(*state.backend, target, state.tasks, [&](const Target& library, const fs::path& path) {
+            if (library.shared_library && library.shared_library->interface_hash) {
+                interfaces.emplace_back(path, library.shared_library->interface_hash);
+            } else {
+                link_inputs.emplace_back(path);
+            }
+        });
+        ForEachLink(target, AddLinkInput);
+        auto link_hash = HashPaths(link_inputs);
+        for (auto&[path, interface_hash] : interfaces) {
+            auto path_str = path.generic_string();
+            link_hash = XXH64(path_str.c_str(), path_str.size() + 1, link_hash);
+            link_hash = XXH64(&interface_hash, sizeof(interface_hash), link_hash);
+        }
+
+        auto output = state.backend->GenerateLinkCommand(target, state.tasks).outputs.front();
+        bool relinked = false;
+        if (auto entry = state.build_log.Find(BuildLogKey(target));
+                entry && entry->inputs_hash == link_hash && IsNewerThanAll(output, link_inputs)) {
+            LogInfo("[{}] is up to date", name);
+            built_path = output;
+        } else {
+            LogInfo("Linking [{}] from [{}]", name, target.name);
+            auto link_start = chr::steady_clock::now();
+            bool res;
+            ResourceUsage link_usage;
+            {
+                ResourceAccountingScope accounting;
+                res = state.backend->LinkStep(target, state.tasks);
+                link_usage = accounting.Usage();
+            }
+            auto link_end = chr::steady_clock::now();
+            TraceEvent(name, res ? "link" : "link (failed)", link_start, link_end);
+            stats.link_records.emplace_back(name, link_usage, res);
+            if (res) {
+                state.build_log.Record(BuildLogKey(target), link_usage, link_hash);
+            }
+            if (!res) {
+                LogError("Error linking [{}] from [{}]", name, target.name);
+                link_errors++;
+                continue;
+            }
+            relinked = true;
+        }
+
+        if (target.shared_library) {
+            auto& library = *target.shared_library;
+            auto previous = state.build_log.Find(BuildLogInterfaceKey(target));
+            if (relinked || !previous) {
+                library.interface_hash = state.backend->HashExportedInterface(output);
+                if (relinked && previous && previous->inputs_hash == library.interface_hash && library.interface_hash) {
+                    LogInfo("Interface of [{}] is unchanged, importers are not relinked", name);
+                }
+                state.build_log.Record(BuildLogInterfaceKey(target), {}, library.interface_hash);
+            } else {
+                library.interface_hash = previous->inputs_hash;
+            }
         }
 
         // Copy shared artifacts
 
         bool logged_copy = false;
 
-        auto out_dir = HarmonyObjectDir / target.name;
-        msvc::ForEachShared(target, [&](const fs::path& shared) {
+        auto out_dir = output.parent_path();
+        ForEachShared(target, [&](const fs::path& shared) {
             auto to = out_dir / shared.filename();
             bool to_exists = fs::exists(to);
             bool do_copy = !to_exists || (fs::last_write_time(to) < fs::last_write_time(shared));
@@ -399,7 +1224,9 @@ bool Build(BuildState& state, bool multithreaded)
         });
     }
 
-    return link_errors == 0;
+    stats.success = link_errors == 0;
+
+    return stats.success;
 }
 
 void Run(BuildState& state, std::string_view to_run)
@@ -416,7 +1243,12 @@ void Run(BuildState& state, std::string_view to_run)
     }
 
     std::string cmd;
+#ifdef _WIN32
     cmd += FormatPath(*target.executable->built_path, PathFormatOptions::Backward | PathFormatOptions::QuoteSpaces | PathFormatOptions::Absolute);
+#else
+    cmd += FormatPath(*target.executable->built_path, PathFormatOptions::Forward | PathFormatOptions::QuoteSpaces | PathFormatOptions::Absolute);
+#endif
     LogCmd(cmd);
+    LogFlush();
     std::system(cmd.c_str());
 }
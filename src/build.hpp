@@ -1,10 +1,13 @@
 #pragma once
 
 #include <core.hpp>
+#include <intern.hpp>
+#include <build-log.hpp>
 
 #ifndef HARMONY_USE_IMPORT_STD
 #include <unordered_set>
 #include <unordered_map>
+#include <memory>
 #endif
 
 struct Backend;
@@ -52,6 +55,21 @@ struct Executable {
     std::optional<fs::path> built_path;
 };
 
+struct SharedLibrary
+{
+    std::string name;
+
+    std::optional<fs::path> built_path;
+    // Hash of the exported symbols, importers are only relinked when it changes. 0 if unknown
+    uint64_t interface_hash = 0;
+};
+
+struct Unity
+{
+    // Maximum number of sources included by one unity translation unit
+    uint32_t batch_size = 8;
+};
+
 struct Git
 {
     std::string url;
@@ -90,18 +108,28 @@ struct TranslationInputs
     std::vector<fs::path> include_dirs;
     std::vector<fs::path> force_includes;
 
-    void MergeBack(const TranslationInputs& other)
-    {
-        if (type == SourceType::Unknown) type = other.type;
+    // Merge inputs inherited from imported targets. Defines are deduplicated by key with local defines taking
+    // precedence, include directories and force includes keep their first occurrence only.
+    void MergeBack(const TranslationInputs& other);
 
-        // TODO: Deduplicate keys instead of prepending defines
-        auto tmp_define = std::move(defines);
-        defines = other.defines;
-        for (auto& define : tmp_define) defines.emplace_back(define);
+    // Stable content hash, identical across runs for identical inputs
+    uint64_t ComputeHash() const;
 
-        for (auto& include : other.include_dirs) include_dirs.emplace_back(include);
-        for (auto& finclude : other.force_includes) force_includes.emplace_back(finclude);
-    }
+    bool operator==(const TranslationInputs&) const = default;
+};
+
+// Interned, immutable translation inputs. Source sets with identical inputs share the same instance, so pointer
+// equality can be used wherever inputs need to be compared (cache keys, BMI compatibility).
+struct InternedTranslationInputs : TranslationInputs
+{
+    uint64_t hash = 0;
+};
+
+struct TranslationInputsPool
+{
+    std::unordered_multimap<uint64_t, std::unique_ptr<InternedTranslationInputs>> entries;
+
+    const InternedTranslationInputs* Intern(TranslationInputs&& inputs);
 };
 
 struct SourceSet
@@ -118,6 +146,8 @@ struct Target {
     TranslationInputs exported_translation_inputs;
 
     std::optional<Executable> executable;
+    std::optional<SharedLibrary> shared_library;
+    std::optional<Unity> unity;
     std::vector<fs::path> links;
     std::vector<fs::path> shared;
 
@@ -129,7 +159,11 @@ struct Target {
     fs::path dir;
 
     // TODO: This is internal build state, move
+    std::vector<std::pair<Target*, DependencyType>> resolved_imports;
+    std::vector<Target*> exported_closure;
     std::unordered_set<Target*> flattened_imports;
+    // Objects end up in a shared library, either directly or through an archive
+    bool position_independent = false;
 };
 
 enum class TaskState
@@ -140,50 +174,224 @@ enum class TaskState
     Failed,
 };
 
+enum class DirtyReason : uint8_t
+{
+    None,
+    MissingOutput,
+    SourceChanged,
+    InputsChanged,
+    DependencyChanged,
+};
+
+inline
+std::string_view DirtyReasonToString(DirtyReason reason)
+{
+    switch (reason) {
+        case DirtyReason::None: return "up to date";
+        case DirtyReason::MissingOutput: return "output missing";
+        case DirtyReason::SourceChanged: return "source newer than output";
+        case DirtyReason::InputsChanged: return "translation inputs changed";
+        case DirtyReason::DependencyChanged: return "dependency rebuilt";
+    }
+    std::unreachable();
+}
+
+enum class TaskKind : uint8_t
+{
+    // Full compilation of a translation unit (and its BMI for interfaces and header units)
+    Compile,
+    // BMI only compilation of a module interface
+    Precompile,
+    // Object generation from the BMI of a precompiled module interface
+    Codegen,
+    // Precompiled header for a shared global module fragment prefix, generated with BuildOptions::auto_pch
+    PrecompiledHeader,
+};
+
 struct Task;
 
+inline constexpr uint32_t InvalidTaskIndex = ~0u;
+
 struct Dependency {
-    std::string name;
-    Task* source;
+    NameId name;
+    // Index into BuildState::tasks, resolved in SortDependencies
+    uint32_t source = InvalidTaskIndex;
 };
 
 struct Task {
     Target* target;
     Source source;
-    TranslationInputs* inputs;
+    // Interned source.path, used as the lookup key for the task's source. Set by SortDependencies
+    PathId source_id = PathId::Invalid;
+    const InternedTranslationInputs* inputs = nullptr;
 
     fs::path bmi;
     fs::path obj;
-    std::string unique_name;
+    // Stored in BuildState::arena
+    std::string_view unique_name;
 
-    std::vector<std::string> produces;
+    std::vector<NameId> produces;
     std::vector<Dependency> depends_on;
+    // Sorted indices of all tasks reachable through depends_on, stored in BuildState::arena by SortDependencies
+    std::span<const uint32_t> references;
     bool is_header_unit = false;
+    TaskKind kind = TaskKind::Compile;
+    // Generated translation unit including the sources moved to BuildState::unity_sources
+    bool unity_batch = false;
+
+    // Headers included at the start of the global module fragment, before any other directive. Only collected for
+    // BuildOptions::auto_pch, and cleared once precompiled headers have been generated
+    std::vector<PathId> global_fragment_includes;
+
+    // Includes of header units in depends_on are translated into imports, set by BuildOptions::promote_header_units
+    bool translate_includes = false;
 
     TaskState state = TaskState::Waiting;
+    ResourceUsage usage;
+
+    // Why the task must be compiled, for DependencyChanged the triggering dependency task is stored in dirty_cause
+    DirtyReason dirty_reason = DirtyReason::None;
+    uint32_t dirty_cause = InvalidTaskIndex;
 
     uint32_t max_depth = 0;
 
     bool external = false;
+
+    // The file used to determine whether the task is up to date
+    const fs::path& PrimaryOutput() const
+    {
+        return (is_header_unit || kind == TaskKind::Precompile || kind == TaskKind::PrecompiledHeader) ? bmi : obj;
+    }
+};
+
+struct TaskRecord
+{
+    uint32_t task;
+    chr::steady_clock::time_point start;
+    chr::steady_clock::time_point end;
+    bool success;
+};
+
+struct LinkRecord
+{
+    std::string name;
+    ResourceUsage usage;
+    bool success;
+};
+
+struct BuildStats
+{
+    std::vector<std::pair<std::string, chr::steady_clock::duration>> phases;
+
+    uint32_t files_scanned = 0;
+    uint64_t bytes_scanned = 0;
+    chr::steady_clock::duration scan_time{};
+
+    uint32_t to_compile = 0;
+    uint32_t skipped = 0;
+    uint32_t compiled = 0;
+    uint32_t failed = 0;
+    uint32_t blocked = 0;
+
+    uint32_t max_threads = 0;
+    uint32_t peak_concurrency = 0;
+    // Invocations of Backend::CompileTaskBatch with multiple tasks, and those that ran more than one process
+    uint32_t batches = 0;
+    uint32_t batch_fallbacks = 0;
+    chr::steady_clock::duration compile_time{};
+    std::vector<TaskRecord> task_records;
+    std::vector<LinkRecord> link_records;
+
+    bool success = false;
+};
+
+struct BuildOptions
+{
+    bool multithreaded = true;
+    bool explain = false;
+    bool auto_pch = false;
+    // Maximum number of frequently included headers to build as header units, 0 to disable
+    uint32_t promote_header_units = 0;
+    fs::path build_log = BuildLogPath;
+    // Recent source edits, used to keep frequently edited files out of unity batches
+    fs::path edit_history = HarmonyDir / "edit-history.json";
 };
 
 struct BuildState
 {
+    BuildOptions options;
+
+    Arena arena;
+
+    // Task storage, indices are stable once dependencies have been resolved. Reordering happens through `order`
     std::vector<Task> tasks;
+    std::vector<uint32_t> order;
+    // Sources compiled as part of a unity batch, not scheduled themselves
+    std::vector<Task> unity_sources;
+
     std::unordered_map<std::string, Target> targets;
+    TranslationInputsPool translation_inputs;
     const Backend* backend;
     std::vector<fs::path> system_includes;
+
+    BuildStats stats;
+    BuildLog build_log;
+};
+
+// Live progress reporting for the compile phase. Shows a status line on terminals, otherwise one line per finished
+// task. The ETA is the larger of the remaining critical path and the remaining work spread over all threads, using
+// task durations from the build log
+struct BuildProgress
+{
+    BuildState& state;
+    bool terminal;
+    bool enabled;
+
+    std::vector<chr::nanoseconds> estimates;
+    std::vector<chr::steady_clock::time_point> started;
+    std::vector<chr::nanoseconds> finish;
+
+    uint32_t total = 0;
+    size_t reported = 0;
+    chr::nanoseconds remaining{};
+    chr::steady_clock::time_point last_estimate;
+
+    BuildProgress(BuildState& state);
+    ~BuildProgress();
+
+    void Started(uint32_t task);
+
+    // Must be called with exclusive access to BuildStats::task_records
+    void Update();
+
+private:
+    void EstimateRemaining(chr::steady_clock::time_point now);
 };
 
 void ParseTargetsFile(BuildState& state, std::string_view config);
 void FetchExternalData(BuildState& state, bool clean, bool update);
+void ResolveImportClosures(BuildState& state);
 void ExpandTargets(BuildState& state);
 void ScanDependencies(BuildState& state, bool use_backend_dependency_scan);
 void DetectAndInsertStdModules(BuildState& state);
+void SplitModuleCompilation(BuildState& state);
+void GeneratePrecompiledHeaders(BuildState& state);
+void GenerateUnityBatches(BuildState& state);
 void SortDependencies(BuildState& state);
 void Flatten(BuildState& state);
-bool Build(BuildState&, bool multithreaded);
+bool Build(BuildState&);
 void Run(BuildState&, std::string_view to_run);
+void WriteBuildStats(const BuildState& state, const fs::path& path);
+
+// Library files to link and shared libraries to copy next to executables, for a target and all of its imports.
+// Shared libraries include those built from imported shared library targets
+void ForEachLink(const Target& target, function_ref<void(const fs::path&)> callback);
+void ForEachShared(const Target& target, function_ref<void(const fs::path&)> callback);
+
+// Stable identity of a task across builds, used as the build log key
+std::string BuildLogKey(const Task& task);
+std::string BuildLogKey(const Target& target);
+std::string BuildLogArchiveKey(const Target& target);
 
 struct Component
 {
@@ -198,6 +406,8 @@ struct Component
     bool exported;
     bool imported;
     bool angled;
+    // Include is part of the static prefix of a global module fragment
+    bool global_fragment_prefix = false;
 };
 
 struct ScanResult
@@ -208,3 +418,6 @@ struct ScanResult
 };
 
 ScanResult ScanFile(const fs::path& path, std::string& storage, function_ref<void(Component&)>);
+
+// Newest modification time of the headers and everything they include, as far as includes can be resolved
+fs::file_time_type NewestIncludeTime(BuildState& state, std::span<const PathId> headers, std::span<const fs::path> include_dirs);
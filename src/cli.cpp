@@ -4,23 +4,44 @@ import std.compat;
 #endif
 
 #include <build.hpp>
+#include <trace.hpp>
 #include <generators/cmake-generator.hpp>
+#include <generators/ninja-generator.hpp>
+#include <generators/compile-commands.hpp>
 
+#include <backend/fake-backend.hpp>
+#ifdef _WIN32
 #include <backend/msvc-backend.hpp>
 #include <backend/clangcl-backend.hpp>
+#else
+#include <backend/clang-backend.hpp>
+#include <backend/gcc-backend.hpp>
+#endif
 
 int main(int argc, char* argv[]) try
 {
+    // Run by the scan edges of generated Ninja builds, before any other setup or logging
+    if (argc == 4 && "-scan-components"sv == argv[1]) {
+        WriteSourceComponents(argv[2], argv[3]);
+        return 0;
+    }
+
     bool wait_on_close = false;
+    std::optional<fs::path> trace_file;
 
     auto start = chr::steady_clock::now();
     HARMONY_DEFER(&) {
         auto end = chr::steady_clock::now();
+        if (trace_file) {
+            TraceEvent("harmony", "phase", start, end);
+            WriteTrace(*trace_file);
+        }
         LogInfo("--------------------------------------------------------------------------------");
         LogInfo("Elapsed: {}", DurationToString(end - start));
         if (wait_on_close) {
             log_level = LogLevel::Info;
             LogInfo("Press enter to close");
+            LogFlush();
             std::cin.get();
         }
     };
@@ -33,14 +54,27 @@ int main(int argc, char* argv[]) try
  -log-[level]        :: Set log level (trace, debug, info *default*, warn, error)
  -wait-on-close      :: Require enter press to close (for debugging purposes)
 
- -clang              :: Use the clang backend
- -msvc               :: Use the msvc backend
+ -clang              :: Use the clang backend (clang-cl on Windows, clang++ with libc++ elsewhere)
+ -msvc               :: Use the msvc backend (Windows only)
+ -gcc                :: Use the g++ backend, with Harmony serving module mapper requests (not on Windows)
+ -fake               :: Use a fake backend that writes placeholder outputs without compiling
+ -fake-duration <ms> :: Time each fake task takes to complete
+ -fake-replay <file> :: Replay task durations from a build log recorded by a real build
+ -fake-fail <text>   :: Fail fake tasks whose source path (or target name) contains text
 
- -toolchain-dep-scan :: Use the toolchain (msvc, clang) provided dependency scan to verify dependencies
+ -toolchain-dep-scan :: Use the toolchain (msvc, clang, gcc) provided dependency scan to verify dependencies
 
  -st                 :: Run build single threaded only for debugging
+ -explain            :: Explain why each out of date task needs to be rebuilt
+ -auto-pch           :: Precompile include prefixes shared by module global fragments (clang)
+ -promote-header-units <count> :: Build the most included headers as header units and import them instead (msvc, gcc)
 
  -workspace <path>   :: Generate CMake workspace at given location
+ -ninja <path>       :: Generate a Ninja build at given location instead of building
+ -compile-commands <file> :: Write a compile_commands.json compilation database
+
+ -trace <file>       :: Write a Chrome/Perfetto trace of all build phases and tasks
+ -stats-json <file>  :: Write machine-readable build statistics
 
  -run <target>       :: Run the associated target after building
 )");
@@ -53,11 +87,22 @@ int main(int argc, char* argv[]) try
 
     // TODO: This should be in profile configuration
     bool use_clang = false;
+    bool use_gcc = false;
+    bool use_fake = false;
+    chr::milliseconds fake_duration{};
+    std::optional<fs::path> fake_replay;
+    std::vector<std::string> fake_fail_patterns;
     bool use_backend_dependency_scan = false;
     bool fetch_dependencies = false;
     bool clean_dependencies = false;
     bool multithreaded = true;
+    bool explain = false;
+    bool auto_pch = false;
+    uint32_t promote_header_units = 0;
     std::optional<fs::path> workspace;
+    std::optional<fs::path> ninja_dir;
+    std::optional<fs::path> compile_commands;
+    std::optional<fs::path> stats_file;
     std::optional<std::string> to_run;
     for (int i = 2; i < argc; ++i) {
         // Check for updates
@@ -76,17 +121,64 @@ int main(int argc, char* argv[]) try
         else if ("-clang"sv == argv[i]) use_clang = true;
         // Use msvc (default)
         else if ("-msvc"sv == argv[i]) use_clang = false;
+        // Use gcc
+        else if ("-gcc"sv == argv[i]) use_gcc = true;
+        // Use fake backend
+        else if ("-fake"sv == argv[i]) use_fake = true;
+        else if ("-fake-duration"sv == argv[i]) {
+            if (++i >= argc) Error("Expected milliseconds after -fake-duration");
+            fake_duration = chr::milliseconds(std::stoul(argv[i]));
+        }
+        else if ("-fake-replay"sv == argv[i]) {
+            if (++i >= argc) Error("Expected build log path after -fake-replay");
+            fake_replay = fs::path(argv[i]);
+        }
+        else if ("-fake-fail"sv == argv[i]) {
+            if (++i >= argc) Error("Expected pattern after -fake-fail");
+            fake_fail_patterns.emplace_back(argv[i]);
+        }
         // Use vendor dependency scan
         else if ("-toolchain-dep-scan"sv == argv[i]) use_backend_dependency_scan = true;
         // Build single threaded
         // TODO: Allow user to select how many threads to use
         //       Should be set in profile?
         else if ("-st"sv == argv[i]) multithreaded = false;
+        // Explain rebuild decisions
+        else if ("-explain"sv == argv[i]) explain = true;
+        // Precompile shared global module fragment includes
+        else if ("-auto-pch"sv == argv[i]) auto_pch = true;
+        // Promote frequently included headers to header units
+        else if ("-promote-header-units"sv == argv[i]) {
+            if (++i >= argc) Error("Expected header count after -promote-header-units");
+            promote_header_units = uint32_t(std::stoul(argv[i]));
+        }
         // Specify a workspace to create
         else if ("-workspace"sv == argv[i]) {
             if (++i >= argc) Error("Expected path after -worksapce");
             workspace = fs::path(argv[i]);
         }
+        // Specify a ninja build directory to generate
+        else if ("-ninja"sv == argv[i]) {
+            if (++i >= argc) Error("Expected path after -ninja");
+            ninja_dir = fs::absolute(argv[i]);
+        }
+        // Write compilation database
+        else if ("-compile-commands"sv == argv[i]) {
+            if (++i >= argc) Error("Expected path after -compile-commands");
+            compile_commands = fs::path(argv[i]);
+        }
+        // Write chrome trace
+        else if ("-trace"sv == argv[i]) {
+            if (++i >= argc) Error("Expected path after -trace");
+            trace_file = fs::path(argv[i]);
+            EnableTracing();
+            TraceLaneName(0, "main");
+        }
+        // Write build statistics
+        else if ("-stats-json"sv == argv[i]) {
+            if (++i >= argc) Error("Expected path after -stats-json");
+            stats_file = fs::path(argv[i]);
+        }
         // Specify a target executable to run
         else if ("-run"sv == argv[i]) {
             if (++i >= argc) Error("Expected target name after -workspace");
@@ -107,13 +199,38 @@ int main(int argc, char* argv[]) try
     fs::create_directories(HarmonyTempDir);
     fs::create_directories(HarmonyObjectDir);
     BuildState state;
+    HARMONY_DEFER(&) {
+        if (stats_file) {
+            WriteBuildStats(state, *stats_file);
+        }
+    };
     std::unique_ptr<Backend> backend;
-    if (use_clang) {
-        backend = std::make_unique<ClangClBackend>();
+    if (use_fake) {
+        auto fake = std::make_unique<FakeBackend>();
+        fake->duration = fake_duration;
+        fake->fail_patterns = fake_fail_patterns;
+        if (fake_replay) fake->LoadReplay(*fake_replay);
+        backend = std::move(fake);
     } else {
-        backend = std::make_unique<MsvcBackend>();
+#ifdef _WIN32
+        if (use_clang) {
+            backend = std::make_unique<ClangClBackend>();
+        } else {
+            backend = std::make_unique<MsvcBackend>();
+        }
+#else
+        if (use_gcc) {
+            backend = std::make_unique<GccBackend>();
+        } else {
+            backend = std::make_unique<ClangBackend>();
+        }
+#endif
     }
     state.backend = backend.get();
+    state.options.multithreaded = multithreaded;
+    state.options.explain = explain;
+    state.options.auto_pch = auto_pch;
+    state.options.promote_header_units = promote_header_units;
 
     // TODO: HUH
     state.backend->AddSystemIncludeDirs(state);
@@ -122,17 +239,51 @@ int main(int argc, char* argv[]) try
     //       store targets via pointers or use indices
     state.targets["std"].name = "std";
 
-    ParseTargetsFile(state, config);
-    FetchExternalData(state, clean_dependencies, fetch_dependencies);
-    ExpandTargets(state);
-    ScanDependencies(state, use_backend_dependency_scan);
-    DetectAndInsertStdModules(state);
-    SortDependencies(state);
-    Flatten(state);
+    auto RunPhase = [&state](std::string_view name, auto&& fn) {
+        TraceScope scope(name);
+        auto phase_start = chr::steady_clock::now();
+        HARMONY_DEFER(&) { state.stats.phases.emplace_back(std::string(name), chr::steady_clock::now() - phase_start); };
+        return fn();
+    };
+
+    RunPhase("parse", [&] { ParseTargetsFile(state, config); });
+    RunPhase("fetch", [&] { FetchExternalData(state, clean_dependencies, fetch_dependencies); });
+    RunPhase("expand", [&] { ExpandTargets(state); });
+    RunPhase("scan", [&] {
+        ScanDependencies(state, use_backend_dependency_scan);
+        GenerateUnityBatches(state);
+        DetectAndInsertStdModules(state);
+        SplitModuleCompilation(state);
+        GeneratePrecompiledHeaders(state);
+    });
+    RunPhase("sort", [&] { SortDependencies(state); });
+    RunPhase("flatten", [&] { Flatten(state); });
     if (workspace) {
-        GenerateCMake(state, *workspace);
+        RunPhase("workspace", [&] { GenerateCMake(state, *workspace); });
+    }
+    if (compile_commands) {
+        RunPhase("compile-commands", [&] { WriteCompileCommands(state, *compile_commands); });
+    }
+    if (ninja_dir) {
+        // Ninja reruns this generation step when the configuration or the module structure of a source changes
+        auto harmony_command = FormatPath(argv[0]);
+        auto regenerate_command = std::format("{} {} -ninja {}", harmony_command,
+            FormatPath(argv[1], PathFormatOptions::QuoteSpaces | PathFormatOptions::Absolute),
+            FormatPath(*ninja_dir));
+        if (use_clang) regenerate_command += " -clang";
+        if (use_gcc) regenerate_command += " -gcc";
+        if (use_fake) regenerate_command += " -fake";
+        if (fake_duration.count()) regenerate_command += std::format(" -fake-duration {}", fake_duration.count());
+        if (fake_replay) regenerate_command += std::format(" -fake-replay {}", QuoteArgument(FormatPath(*fake_replay, PathFormatOptions::Absolute)));
+        for (auto& pattern : fake_fail_patterns) regenerate_command += std::format(" -fake-fail {}", QuoteArgument(pattern));
+        if (use_backend_dependency_scan) regenerate_command += " -toolchain-dep-scan";
+        if (auto_pch) regenerate_command += " -auto-pch";
+        if (promote_header_units) regenerate_command += std::format(" -promote-header-units {}", promote_header_units);
+
+        RunPhase("ninja", [&] { GenerateNinja(state, *ninja_dir, fs::absolute(argv[1]), harmony_command, regenerate_command); });
+        return 0;
     }
-    if (!Build(state, multithreaded)) {
+    if (!RunPhase("build", [&] { return Build(state); })) {
         Error("Build failed, exiting");
     }
     LogInfo("Build success");
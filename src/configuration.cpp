@@ -139,6 +139,20 @@ void ParseTargetsFile(BuildState& state, std::string_view config)
             );
         }
 
+        if (auto shared_library = in_target["shared-library"]) {
+            if (out_target.executable) Error("Target [{}] can't be both an executable and a shared library", name);
+            auto library_name = shared_library["name"].string();
+            out_target.shared_library.emplace(library_name ? library_name : out_target.name);
+        }
+
+        if (auto in_unity = in_target["unity"]) {
+            auto& unity = out_target.unity.emplace();
+            if (auto batch_size = in_unity["batch-size"].uint64()) {
+                if (*batch_size < 2) Error("Unity batch size of target [{}] must be at least 2", name);
+                unity.batch_size = uint32_t(*batch_size);
+            }
+        }
+
         if (auto in_git = in_target["git"]) {
             auto& git = out_target.git.emplace();
             if (in_git.string()) {
@@ -193,10 +207,80 @@ void ParseTargetsFile(BuildState& state, std::string_view config)
     }
 }
 
+void ResolveImportClosures(BuildState& state)
+{
+    LogDebug("Resolving import closures");
+
+    enum class Mark { None, Visiting, Done };
+
+    std::unordered_map<Target*, Mark> marks;
+    std::vector<Target*> stack;
+    std::vector<Target*> order;
+    order.reserve(state.targets.size());
+
+    // Topologically order targets (imports before importers), reporting the full chain on cycles
+
+    auto Visit = [&](this auto&& self, Target& cur) -> void {
+        auto& mark = marks[&cur];
+        if (mark == Mark::Done) return;
+        if (mark == Mark::Visiting) {
+            std::string cycle;
+            for (auto iter = std::ranges::find(stack, &cur); iter != stack.end(); ++iter) {
+                cycle += std::format("[{}] -> ", (*iter)->name);
+            }
+            cycle += std::format("[{}]", cur.name);
+            Error("Found recursive dependency: {}", cycle);
+        }
+        mark = Mark::Visiting;
+        stack.emplace_back(&cur);
+
+        cur.resolved_imports.clear();
+        for (auto&[import_name, type] : cur.imported_targets) {
+            auto iter = state.targets.find(import_name);
+            if (iter == state.targets.end()) {
+                Error("Target [{}] imports unknown target [{}]", cur.name, import_name);
+            }
+            cur.resolved_imports.emplace_back(&iter->second, type);
+            self(iter->second);
+        }
+
+        stack.pop_back();
+        mark = Mark::Done;
+        order.emplace_back(&cur);
+    };
+
+    for (auto&[_, target] : state.targets) {
+        Visit(target);
+    }
+
+    // Compute closures once per target, reusing the already computed closures of imported targets
+
+    for (auto* target : order) {
+        target->exported_closure.clear();
+        target->flattened_imports.clear();
+
+        std::unordered_set<Target*> exported;
+        auto AddExported = [&](Target* t) {
+            if (exported.emplace(t).second) target->exported_closure.emplace_back(t);
+        };
+
+        for (auto[imported, type] : target->resolved_imports) {
+            target->flattened_imports.emplace(imported);
+            target->flattened_imports.insert(imported->flattened_imports.begin(), imported->flattened_imports.end());
+
+            if (type == DependencyType::Private) continue;
+            AddExported(imported);
+            for (auto* t : imported->exported_closure) AddExported(t);
+        }
+    }
+}
+
 void ExpandTargets(BuildState& state)
 {
     LogInfo("Expanding targets");
 
+    ResolveImportClosures(state);
+
     for (auto&[_, target] : state.targets) {
 
         LogTrace("Expanding target: {}", target.name);
@@ -208,44 +292,35 @@ void ExpandTargets(BuildState& state)
 
         TranslationInputs imported_translation_inputs;
 
-        std::unordered_set<Target*> flattened;
-        [&](this auto&& self, Target& cur) -> void {
-            if (flattened.contains(&cur)) {
-                Error("Found recursive dependency on {} (repeated = {})", target.name, cur.name);
+        std::unordered_set<Target*> imported_from;
+        auto Import = [&](Target& imported) {
+            if (!imported_from.emplace(&imported).second) return;
+            LogTrace("  importing from [{}]", imported.name);
+
+            for (auto& include_dir : imported.exported_translation_inputs.include_dirs) {
+                LogTrace("    includes: {}", include_dir.string());
+                imported_translation_inputs.include_dirs.emplace_back(include_dir);
             }
-            flattened.emplace(&cur);
-
-            for (auto[import_name, type] : cur.imported_targets) {
-                LogTrace("  importing from [{}]", import_name);
-                try {
-                    auto& imported = state.targets.at(import_name);
-
-                    if (   (&cur == &target && type != DependencyType::Interface)
-                        || (&cur != &target && type != DependencyType::Private))
-                    {
-                        for (auto& include_dir : imported.exported_translation_inputs.include_dirs) {
-                            LogTrace("    includes: {}", include_dir.string());
-                            imported_translation_inputs.include_dirs.emplace_back(include_dir);
-                        }
 
-                        for (auto& define : imported.exported_translation_inputs.defines) {
-                            LogTrace("    defines:  {}", define);
-                            imported_translation_inputs.defines.emplace_back(define);
-                        }
+            for (auto& define : imported.exported_translation_inputs.defines) {
+                LogTrace("    defines:  {}", define);
+                imported_translation_inputs.defines.emplace_back(define);
+            }
+        };
 
-                        self(imported);
-                    }
-                } catch (std::exception& e) {
-                    Error(e.what());
-                }
+        for (auto[imported, type] : target.resolved_imports) {
+            if (type == DependencyType::Interface) continue;
+            Import(*imported);
+            for (auto* exported : imported->exported_closure) {
+                Import(*exported);
             }
-        }(target);
+        }
 
         for (auto& source_set : target.sources) {
             LogTrace("  Expanding Source Set");
-            // TODO: Memory cleanup
-            auto* inputs = new TranslationInputs(source_set.inputs);
-            inputs->MergeBack(imported_translation_inputs);
+            auto merged_inputs = source_set.inputs;
+            merged_inputs.MergeBack(imported_translation_inputs);
+            auto* inputs = state.translation_inputs.Intern(std::move(merged_inputs));
 
             auto AddSourceFile = [&](const fs::path& file, SourceType type) {
                 LogTrace("      Scanning: {} (type = {})", file.string(), SourceTypeToString(type));
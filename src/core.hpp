@@ -6,6 +6,10 @@
 #include <string_view>
 #include <fstream>
 #include <source_location>
+#include <memory>
+#include <vector>
+#include <span>
+#include <cstring>
 #endif
 
 #include <log.hpp>
@@ -100,8 +104,15 @@ namespace harmony::detail
 
 // -----------------------------------------------------------------------------
 
-// TODO: This should use Platform specific environment helper
-inline const fs::path HarmonyDir = fs::path(std::getenv("USERPROFILE")) / ".harmony";
+inline
+fs::path GetUserHomeDir()
+{
+    if (auto profile = std::getenv("USERPROFILE")) return profile;
+    if (auto home = std::getenv("HOME")) return home;
+    return fs::current_path();
+}
+
+inline const fs::path HarmonyDir = GetUserHomeDir() / ".harmony";
 inline const fs::path HarmonyDataDir = HarmonyDir / "data";
 inline const fs::path HarmonyTempDir = HarmonyDir / "tmp";
 inline const fs::path HarmonyObjectDir = HarmonyDir / "out";
@@ -202,6 +213,21 @@ void WriteStringToFile(const fs::path& path, std::string_view contents)
     out.write(contents.data(), contents.size());
 }
 
+// Skip writing when the file already has the given contents, so that timestamp based tools don't see a change.
+// New contents are written to a temporary file and moved into place, so readers never observe a partial file.
+// Returns true if the file was written
+inline
+bool WriteFileIfChanged(const fs::path& path, std::string_view contents)
+{
+    if (fs::exists(path) && fs::file_size(path) == contents.size() && ReadFileToString(path) == contents) {
+        return false;
+    }
+    auto temp_path = fs::path(path).concat(".tmp");
+    WriteStringToFile(temp_path, contents);
+    fs::rename(temp_path, path);
+    return true;
+}
+
 // -----------------------------------------------------------------------------
 
 template<typename Ret, typename... Types>
@@ -231,3 +257,63 @@ struct function_ref : GetFunctionImpl<Sig>::type {
             })
     {};
 };
+
+// -----------------------------------------------------------------------------
+
+// Bump allocator for build lifetime data. Memory is only released when the arena is destroyed.
+// Not thread safe, allocate from a single thread only.
+class Arena
+{
+    static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte* cur = nullptr;
+    std::byte* end = nullptr;
+    size_t reserved = 0;
+    size_t used = 0;
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        auto aligned = reinterpret_cast<std::byte*>((reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1));
+        if (!cur || aligned + size > end) {
+            auto block_size = std::max(DefaultBlockSize, size + align);
+            auto& block = blocks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+            cur = block.get();
+            end = cur + block_size;
+            reserved += block_size;
+            aligned = reinterpret_cast<std::byte*>((reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1));
+        }
+        cur = aligned + size;
+        used += size;
+        return aligned;
+    }
+
+    // Copy a string into the arena, the returned view is valid for the lifetime of the arena
+    std::string_view Store(std::string_view str)
+    {
+        if (str.empty()) return {};
+        auto data = static_cast<char*>(Allocate(str.size(), 1));
+        std::memcpy(data, str.data(), str.size());
+        return { data, str.size() };
+    }
+
+    // Copy trivially copyable values into the arena, the returned span is valid for the lifetime of the arena
+    template<typename T>
+    std::span<const T> StoreArray(std::span<const T> values)
+    {
+        if (values.empty()) return {};
+        auto data = static_cast<T*>(Allocate(values.size_bytes(), alignof(T)));
+        std::memcpy(data, values.data(), values.size_bytes());
+        return { data, values.size() };
+    }
+
+    size_t BytesUsed() const noexcept { return used; }
+    size_t BytesReserved() const noexcept { return reserved; }
+};
@@ -2,11 +2,9 @@
 
 #ifndef HARMONY_USE_IMPORT_STD
 #include <ranges>
+#include <sstream>
 #endif
 
-// TODO: DELETEME - Only for temporary usage of the link discovery code
-#include <backend/msvc-common.hpp>
-
 void GenerateCMake(BuildState& state, const fs::path& workspace_dir)
 {
     fs::create_directories(workspace_dir);
@@ -17,11 +15,19 @@ void GenerateCMake(BuildState& state, const fs::path& workspace_dir)
     //   Solution: Generate symbolic/hard links to trick CMake?
     //   Solution: Generate additional CMakeLists.txt and include them?
 
-    std::ofstream out(workspace_dir / "CMakeLists.txt", std::ios::binary);
+    // Output is generated in memory and only written on change, so that IDEs don't see unnecessary reconfigures.
+    // Each target is written to its own fragment so that changes to one target leave the others untouched
+
+    auto fragments_dir = workspace_dir / "targets";
+    fs::create_directories(fragments_dir);
 
-    out << "cmake_minimum_required(VERSION 3.30.3)\n";
+    std::ostringstream root;
+    std::unordered_set<std::string> fragments;
+    uint32_t files_written = 0;
 
-    out << R"(set(CMAKE_CXX_STANDARD 23)
+    root << "cmake_minimum_required(VERSION 3.30.3)\n";
+
+    root << R"(set(CMAKE_CXX_STANDARD 23)
 set(CMAKE_CXX_STANDARD_REQUIRED True)
 add_compile_options(
         /Zc:preprocessor
@@ -45,7 +51,7 @@ project(harmony_generated LANGUAGES CXX C)
 
     for (auto&[_, target] : state.targets) {
         bool empty = false;
-        if (target.executable) empty = true;
+        if (target.executable || target.shared_library) empty = true;
         if (!empty) {
             for (auto& task : state.tasks) {
                 if (task.target != &target) continue;
@@ -58,7 +64,13 @@ project(harmony_generated LANGUAGES CXX C)
         }
     }
 
-    for (auto&[name, target] : state.targets) {
+    // Sort targets to keep output stable between runs
+    std::vector<std::pair<const std::string, Target>*> sorted_targets;
+    for (auto& entry : state.targets) sorted_targets.emplace_back(&entry);
+    std::ranges::sort(sorted_targets, {}, [](auto* entry) -> const std::string& { return entry->first; });
+
+    for (auto* entry : sorted_targets) {
+        auto&[name, target] = *entry;
 
         auto target_path = fs::absolute(target.dir);
         auto link_path = workspace_dir / target.name;
@@ -86,16 +98,19 @@ project(harmony_generated LANGUAGES CXX C)
             // return fs::path(target.name) / fs::relative(in, target_path);
         };
 
+        std::ostringstream out;
+
         {
             // TODO: Different sources sets in target might have different TU inputs now!
-            std::vector<std::string>* defines = nullptr;
-            std::vector<fs::path>* includes = nullptr;
+            const std::vector<std::string>* defines = nullptr;
+            const std::vector<fs::path>* includes = nullptr;
 
             std::vector<Task*> source_tasks;
             std::vector<Task*> module_tasks;
 
-            for (auto& task : state.tasks) {
-                if (task.target != &target) continue;
+            auto AddTask = [&](Task& task) {
+                if (task.target != &target) return;
+                if (task.kind == TaskKind::Codegen || task.kind == TaskKind::PrecompiledHeader) return;
 
                 if (task.source.type == SourceType::CppInterface && !task.produces.empty()) {
                     module_tasks.emplace_back(&task);
@@ -105,7 +120,18 @@ project(harmony_generated LANGUAGES CXX C)
 
                 defines = &task.inputs->defines;
                 includes = &task.inputs->include_dirs;
+            };
+
+            // Unity batches are generated by Harmony, the workspace lists the batched sources instead
+            for (auto& task : state.tasks) {
+                if (!task.unity_batch) AddTask(task);
             }
+            for (auto& task : state.unity_sources) {
+                AddTask(task);
+            }
+
+            std::ranges::sort(module_tasks, {}, [](Task* task) -> const fs::path& { return task->source.path; });
+            std::ranges::sort(source_tasks, {}, [](Task* task) -> const fs::path& { return task->source.path; });
 
             // TODO: Reuse empty_targets and avoid storing tasks in prepass!
             bool any_sources = !source_tasks.empty() || !module_tasks.empty();
@@ -113,6 +139,9 @@ project(harmony_generated LANGUAGES CXX C)
             if (target.executable) {
                 out << "# ------------------------------------------------------------------------------\n";
                 out << "add_executable(" << name << ")\n";
+            } else if (target.shared_library) {
+                out << "# ------------------------------------------------------------------------------\n";
+                out << "add_library(" << name << " SHARED)\n";
             } else if (any_sources) {
                 out << "# ------------------------------------------------------------------------------\n";
                 out << "add_library(" << name << ")\n";
@@ -143,7 +172,7 @@ project(harmony_generated LANGUAGES CXX C)
                     out << "        FILE_SET CXX_MODULES TYPE CXX_MODULES FILES\n";
                     for (auto& task : module_tasks) {
                         // PartitionMaybe(*task, "PUBLIC FILE_SET CXX_MODULES TYPE CXX_MODULES FILES");
-                        out << "        " << FormatPath(ReparentToWorkspace(task->source.path)) << " # " << task->max_depth << '\n';
+                        out << "        " << FormatPath(ReparentToWorkspace(task->source.path)) << '\n';
                     }
                 }
                 if (!source_tasks.empty()) {
@@ -158,8 +187,8 @@ project(harmony_generated LANGUAGES CXX C)
 
             // Scan for sources with different source types
             // TODO: How to prevent these from override "leaking" out
-            for (auto& task : state.tasks) {
-                if (task.target != &target) continue;
+            for (auto* _task : source_tasks) {
+                auto& task = *_task;
 
                 // Source type is automatic
                 if (task.inputs->type == SourceType::Unknown) continue;
@@ -199,19 +228,58 @@ project(harmony_generated LANGUAGES CXX C)
             if (!empty_targets.contains(&target) && !target.imported_targets.empty()) {
                 out << "target_link_libraries(" << name << '\n';
                 out << "        PRIVATE\n";
-                for (auto&[import, type] : target.imported_targets) {
+                std::vector<std::string_view> imports;
+                for (auto&[import, type] : target.imported_targets) imports.emplace_back(import);
+                std::ranges::sort(imports);
+                for (auto import : imports) {
                     // TODO: PUBLIC/PRIVATE/INTERFACE
-                    if (!empty_targets.contains(&state.targets.at(import))) {
+                    if (!empty_targets.contains(&state.targets.at(std::string(import)))) {
                         out << "        " << import << '\n';
                     }
                 }
 
-                msvc::ForEachLink(target, [&](auto& link) {
+                ForEachLink(target, [&](auto& link) {
                     out << "        ${CMAKE_SOURCE_DIR}/" << FormatPath(ReparentToWorkspace(link)) << '\n';
                 });
 
                 out << "        )\n";
             }
         }
+
+        auto fragment = out.str();
+        if (fragment.empty()) continue;
+
+        auto fragment_name = std::format("{}.cmake", name);
+        fragments.emplace(fragment_name);
+        root << "include(${CMAKE_CURRENT_LIST_DIR}/targets/" << fragment_name << ")\n";
+        if (WriteFileIfChanged(fragments_dir / fragment_name, fragment)) {
+            LogDebug("  Updated [{}]", fragment_name);
+            files_written++;
+        }
+    }
+
+    // Remove fragments for targets that no longer exist
+
+    std::vector<fs::path> stale;
+    for (auto& iter : fs::directory_iterator(fragments_dir)) {
+        auto& path = iter.path();
+        if (path.extension() != ".cmake" || fragments.contains(path.filename().string())) continue;
+        stale.emplace_back(path);
+    }
+    for (auto& path : stale) {
+        LogDebug("  Removing stale [{}]", path.filename().string());
+        fs::remove(path);
+        files_written++;
+    }
+
+    if (WriteFileIfChanged(workspace_dir / "CMakeLists.txt", root.str())) {
+        LogDebug("  Updated [CMakeLists.txt]");
+        files_written++;
+    }
+
+    if (files_written) {
+        LogInfo("  Updated {} workspace file(s)", files_written);
+    } else {
+        LogInfo("  Workspace is up to date");
     }
 }
@@ -0,0 +1,90 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "compile-commands.hpp"
+
+#include <json.hpp>
+#include <backend/backend.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <fstream>
+#endif
+
+// Entries are streamed to disk in chunks of this size, the full database is never held in memory
+static constexpr size_t FlushThreshold = 1024 * 1024;
+
+static
+bool FileContentsEqual(const fs::path& a, const fs::path& b)
+{
+    if (!fs::exists(a) || !fs::exists(b) || fs::file_size(a) != fs::file_size(b)) return false;
+
+    std::ifstream in_a(a, std::ios::binary), in_b(b, std::ios::binary);
+    std::vector<char> buf_a(64 * 1024), buf_b(64 * 1024);
+    while (in_a && in_b) {
+        in_a.read(buf_a.data(), buf_a.size());
+        in_b.read(buf_b.data(), buf_b.size());
+        if (in_a.gcount() != in_b.gcount()) return false;
+        if (!std::equal(buf_a.begin(), buf_a.begin() + in_a.gcount(), buf_b.begin())) return false;
+    }
+    return true;
+}
+
+void WriteCompileCommands(BuildState& state, const fs::path& path)
+{
+    LogInfo("Writing compile commands to [{}]", path.string());
+
+    state.backend->AddTaskInfo(state.tasks);
+    state.backend->AddTaskInfo(state.unity_sources);
+
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path());
+    }
+
+    auto temp_path = fs::path(path).concat(".tmp");
+    std::ofstream out(temp_path, std::ios::binary);
+    JsonWriter json;
+    auto Flush = [&] {
+        out.write(json.out.data(), json.out.size());
+        json.out.clear();
+    };
+
+    json.BeginArray();
+    auto WriteEntry = [&](const Task& task) {
+        // Arguments are written unquoted, avoiding any ambiguity in shell quoting rules
+        auto command = state.backend->GenerateCompileCommand(task, state.tasks);
+        json.BeginObject()
+            .Field("directory", fs::absolute(command.working_dir).string());
+        json.Key("arguments").BeginArray();
+        for (auto arg : command.Args()) {
+            json.String(arg);
+        }
+        json.EndArray()
+            .Field("file", fs::absolute(task.source.path).string())
+            .Field("output", fs::absolute(command.outputs.front()).string())
+            .EndObject();
+        if (json.out.size() >= FlushThreshold) Flush();
+    };
+    for (auto& task : state.tasks) {
+        // One entry per source, the precompile step carries the source's flags. Generated headers aren't sources
+        if (task.kind == TaskKind::Codegen || task.kind == TaskKind::PrecompiledHeader) continue;
+        WriteEntry(task);
+    }
+    // Sources compiled in unity batches keep their own entries for tools that work per source
+    for (auto& task : state.unity_sources) {
+        WriteEntry(task);
+    }
+    json.EndArray();
+    Flush();
+    out.close();
+
+    // Leave an unchanged database untouched, so that timestamp based tools don't see a change
+    if (FileContentsEqual(temp_path, path)) {
+        fs::remove(temp_path);
+        LogDebug("  Compile commands unchanged");
+    } else {
+        fs::rename(temp_path, path);
+        LogDebug("  Compile commands updated");
+    }
+}
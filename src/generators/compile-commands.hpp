@@ -0,0 +1,7 @@
+#pragma once
+
+#include "build.hpp"
+
+// Write a clang compile database for all tasks using the active backend's command lines. The file is replaced
+// atomically, and left untouched if the contents are unchanged
+void WriteCompileCommands(BuildState& state, const fs::path& path);
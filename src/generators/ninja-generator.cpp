@@ -0,0 +1,315 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include "ninja-generator.hpp"
+
+#include <backend/backend.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <iterator>
+#include <ranges>
+#include <unordered_set>
+#endif
+
+static constexpr std::string_view NinjaManifestName = "build.ninja";
+
+// Escape a path for use as an input or output of a build statement
+static
+std::string NinjaPath(const fs::path& path)
+{
+    auto str = FormatPath(path, PathFormatOptions::Forward | PathFormatOptions::Absolute);
+    std::string out;
+    out.reserve(str.size());
+    for (auto c : str) {
+        if (c == '$' || c == ' ' || c == ':') out += '$';
+        out += c;
+    }
+    return out;
+}
+
+// Escape a variable value, newlines can't be represented and are replaced with spaces
+static
+std::string NinjaValue(std::string_view value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (auto c : value) {
+        if (c == '$') out += "$$";
+        else if (c == '\n' || c == '\r') out += ' ';
+        else out += c;
+    }
+    return out;
+}
+
+// Ninja always runs commands from the build directory
+static
+std::string CommandInWorkingDir(const Command& command)
+{
+#ifdef _WIN32
+    // Commands run through cmd.exe, which limits command lines to 8191 characters
+    return std::format("cmd /c cd /d {} && {}",
+        QuoteArgument(FormatPath(command.working_dir, PathFormatOptions::Backward | PathFormatOptions::Absolute)),
+        command.ToString(7000));
+#else
+    return std::format("cd {} && {}",
+        QuoteArgument(FormatPath(command.working_dir, PathFormatOptions::Forward | PathFormatOptions::Absolute)),
+        command.ToString());
+#endif
+}
+
+// Remove a file if it exists, run before a command that would otherwise update it
+static
+std::string RemoveFile(const fs::path& path)
+{
+#ifdef _WIN32
+    auto path_str = QuoteArgument(FormatPath(path, PathFormatOptions::Backward | PathFormatOptions::Absolute));
+    return std::format("cmd /c if exist {0} del {0}", path_str);
+#else
+    return std::format("rm -f {}", QuoteArgument(FormatPath(path, PathFormatOptions::Forward | PathFormatOptions::Absolute)));
+#endif
+}
+
+// Copy a file, replacing any existing copy
+static
+std::string CopyArtifact(const fs::path& from, const fs::path& to)
+{
+#ifdef _WIN32
+    return std::format("cmd /c copy /y {} {} >nul",
+        QuoteArgument(FormatPath(from, PathFormatOptions::Backward | PathFormatOptions::Absolute)),
+        QuoteArgument(FormatPath(to, PathFormatOptions::Backward | PathFormatOptions::Absolute)));
+#else
+    return std::format("cp -f {} {}",
+        QuoteArgument(FormatPath(from, PathFormatOptions::Forward | PathFormatOptions::Absolute)),
+        QuoteArgument(FormatPath(to, PathFormatOptions::Forward | PathFormatOptions::Absolute)));
+#endif
+}
+
+// Sources written by Harmony itself (unity batches, precompiled headers), which are recreated on regeneration
+static
+bool IsGeneratedSource(const fs::path& path)
+{
+    auto relative = path.lexically_relative(HarmonyTempDir);
+    return !relative.empty() && *relative.begin() != "..";
+}
+
+static
+std::string_view CompileRule(HeaderDependencyFormat format)
+{
+    switch (format) {
+        break;case HeaderDependencyFormat::Gcc: return "compile_gcc";
+        break;case HeaderDependencyFormat::Msvc: return "compile_msvc";
+        break;default: return "run";
+    }
+}
+
+void WriteSourceComponents(const fs::path& source, const fs::path& output)
+{
+    std::string storage;
+    std::string components;
+    ScanFile(source, storage, [&](Component& comp) {
+        components += std::format("{} {:d}{:d}{:d}{:d} {}\n", int(comp.type),
+            comp.exported, comp.imported, comp.angled, comp.global_fragment_prefix, comp.name);
+    });
+
+    fs::create_directories(output.parent_path());
+    WriteFileIfChanged(output, components);
+}
+
+void GenerateNinja(BuildState& state, const fs::path& build_dir, const fs::path& config_path,
+    std::string_view harmony_command, std::string_view regenerate_command)
+{
+    LogInfo("Generating Ninja build in [{}]", build_dir.string());
+
+    fs::create_directories(build_dir);
+
+    state.backend->AddTaskInfo(state.tasks);
+
+    std::string out;
+    auto Write = [&]<class... Args>(std::format_string<Args...> fmt, Args&&... args) {
+        std::format_to(std::back_inserter(out), fmt, std::forward<Args>(args)...);
+    };
+
+    Write("# Generated by Harmony, do not edit\n");
+    Write("ninja_required_version = 1.10\n\n");
+
+    Write("rule run\n");
+    Write("  command = $cmd\n");
+    Write("  description = $desc\n");
+    Write("  restat = 1\n\n");
+
+    Write("rule compile_gcc\n");
+    Write("  command = $cmd\n");
+    Write("  description = $desc\n");
+    Write("  depfile = $out.d\n");
+    Write("  deps = gcc\n");
+    Write("  restat = 1\n\n");
+
+    Write("rule compile_msvc\n");
+    Write("  command = $cmd\n");
+    Write("  description = $desc\n");
+    Write("  deps = msvc\n");
+    Write("  restat = 1\n\n");
+
+    Write("rule regenerate\n");
+    Write("  command = {}\n", NinjaValue(regenerate_command));
+    Write("  description = Regenerating Ninja build\n");
+    Write("  generator = 1\n");
+    Write("  restat = 1\n\n");
+
+    // Each source has a scan edge recording its includes, imports and module declarations. The record is only
+    // rewritten when these change, so edits that keep them regenerate nothing, while changed module dependencies
+    // regenerate the build with updated edges and commands
+
+    std::vector<const Task*> scanned;
+    for (auto& task : state.tasks) {
+        if (task.kind == TaskKind::Codegen || task.kind == TaskKind::PrecompiledHeader) continue;
+        if (IsGeneratedSource(task.source.path)) continue;
+        scanned.emplace_back(&task);
+    }
+    for (auto& task : state.unity_sources) {
+        scanned.emplace_back(&task);
+    }
+
+    auto scan_dir = build_dir / "scan";
+    std::unordered_set<std::string_view> scanned_names;
+    std::vector<fs::path> scan_outputs;
+    for (auto* task : scanned) {
+        if (!scanned_names.emplace(task->unique_name).second) continue;
+        auto& scan_output = scan_outputs.emplace_back(scan_dir / std::format("{}.components", task->unique_name));
+        WriteSourceComponents(task->source.path, scan_output);
+
+        Write("build {}: run {}\n", NinjaPath(scan_output), NinjaPath(task->source.path));
+        Write("  cmd = {}\n", NinjaValue(std::format("{} -scan-components {} {}", harmony_command,
+            QuoteArgument(FormatPath(task->source.path, PathFormatOptions::Absolute)),
+            QuoteArgument(FormatPath(scan_output, PathFormatOptions::Absolute)))));
+        Write("  desc = Scanning {}\n\n", task->unique_name);
+    }
+
+    Write("build {}: regenerate {}", NinjaManifestName, NinjaPath(config_path));
+    if (!scan_outputs.empty()) {
+        Write(" |");
+        for (auto& scan_output : scan_outputs) {
+            Write(" $\n    {}", NinjaPath(scan_output));
+        }
+    }
+    Write("\n\n");
+
+    // Compile edges, with the module dependencies found when the build was generated as implicit inputs
+
+    for (auto& task : state.tasks) {
+        auto command = state.backend->GenerateCompileCommand(task, state.tasks);
+        fs::create_directories(command.working_dir);
+
+        // Codegen only reads the BMI of its interface
+        auto header_deps = HeaderDependencyFormat::None;
+        if (task.kind != TaskKind::Codegen) header_deps = state.backend->AddHeaderDependencyFlags(command);
+
+        auto primary = NinjaPath(command.outputs.front());
+
+        Write("build {}", primary);
+        if (command.outputs.size() > 1) {
+            Write(" |");
+            for (auto& output : command.outputs | std::views::drop(1)) {
+                Write(" {}", NinjaPath(output));
+            }
+        }
+        Write(": {} {}", CompileRule(header_deps), NinjaPath(task.source.path));
+        // Direct dependencies are sufficient, transitive ordering follows from the dependency's own edge
+        if (!task.depends_on.empty()) {
+            Write(" |");
+            for (auto& dep : task.depends_on) {
+                Write(" {}", NinjaPath(state.tasks[dep.source].bmi));
+            }
+        }
+        Write("\n");
+        Write("  cmd = {}\n", NinjaValue(CommandInWorkingDir(command)));
+        Write("  desc = Compiling {}\n\n", task.unique_name);
+    }
+
+    // Archive edges, libraries are always recreated from all of their members
+
+    for (auto&[_, target] : state.targets) {
+        if (target.executable || target.shared_library) continue;
+
+        std::vector<fs::path> objects;
+        ForEachObject(*state.backend, target, state.tasks, [&](const fs::path& obj) { objects.emplace_back(obj); });
+        if (objects.empty()) continue;
+
+        auto command = state.backend->GenerateArchiveCommand(target, objects, false);
+        fs::create_directories(command.working_dir);
+
+        auto archive = NinjaPath(command.outputs.front());
+        Write("build {}: run", archive);
+        for (auto& obj : objects) {
+            Write(" $\n    {}", NinjaPath(obj));
+        }
+        Write("\n");
+        Write("  cmd = {}\n", NinjaValue(std::format("{} && {}", RemoveFile(command.outputs.front()), CommandInWorkingDir(command))));
+        Write("  desc = Archiving {}\n\n", target.name);
+    }
+
+    // Link edges. Shared library targets are linked by their own edge, so their outputs are known before the
+    // shared artifacts of importers are collected
+
+    std::vector<std::pair<Target*, Command>> links;
+    for (auto&[_, target] : state.targets) {
+        if (!target.executable && !target.shared_library) continue;
+
+        auto& command = links.emplace_back(&target, state.backend->GenerateLinkCommand(target, state.tasks)).second;
+        fs::create_directories(command.working_dir);
+        if (target.shared_library) target.shared_library->built_path = command.outputs.front();
+    }
+
+    // Shared artifacts are copied next to each linked output, as in Build
+
+    std::unordered_set<std::string> copied;
+    for (auto&[target, command] : links) {
+        std::vector<std::string> copies;
+        auto out_dir = command.outputs.front().parent_path();
+        ForEachShared(*target, [&](const fs::path& shared) {
+            auto to = out_dir / shared.filename();
+            if (to == shared) return;
+            auto to_str = NinjaPath(to);
+            copies.emplace_back(to_str);
+            if (!copied.emplace(to_str).second) return;
+
+            Write("build {}: run {}\n", to_str, NinjaPath(shared));
+            Write("  cmd = {}\n", NinjaValue(CopyArtifact(shared, to)));
+            Write("  desc = Copying {}\n\n", shared.filename().string());
+        });
+
+        Write("build {}", NinjaPath(command.outputs.front()));
+        for (size_t i = 1; i < command.outputs.size(); ++i) {
+            Write("{}{}", i == 1 ? " | " : " ", NinjaPath(command.outputs[i]));
+        }
+        Write(": run");
+        auto AddInput = [&](const fs::path& input) {
+            Write(" $\n    {}", NinjaPath(input));
+        };
+        ForEachObject(*state.backend, *target, state.tasks, AddInput);
+        ForEachImportedLibrary(*state.backend, *target, state.tasks, [&](const Target&, const fs::path& library) { AddInput(library); });
+        bool any_links = false;
+        ForEachLink(*target, [&](const fs::path& link) {
+            Write(" {}{}", any_links ? "" : "| $\n    ", NinjaPath(link));
+            any_links = true;
+        });
+        // Building an output alone still copies the artifacts it needs at runtime
+        if (!copies.empty()) {
+            Write(" ||");
+            for (auto& copy : copies) {
+                Write(" $\n    {}", copy);
+            }
+        }
+        Write("\n");
+        Write("  cmd = {}\n", NinjaValue(CommandInWorkingDir(command)));
+        Write("  desc = Linking {}\n\n", target->executable ? target->executable->name : target->shared_library->name);
+    }
+
+    auto manifest_path = build_dir / NinjaManifestName;
+
+    if (WriteFileIfChanged(manifest_path, out)) {
+        LogDebug("  Updated [{}]", manifest_path.string());
+    }
+}
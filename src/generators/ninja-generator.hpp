@@ -0,0 +1,13 @@
+#pragma once
+
+#include "build.hpp"
+
+// Write a build.ninja for the resolved task graph into build_dir. Module dependencies found by the scanner are
+// implicit inputs of the compile edges, header dependencies are reported by the compiler. The regenerate command is
+// run by ninja to refresh the file whenever the build configuration changes, or the includes, imports or module
+// declarations of a source change as recorded by per-source scan edges running harmony_command -scan-components
+void GenerateNinja(BuildState& state, const fs::path& build_dir, const fs::path& config_path,
+    std::string_view harmony_command, std::string_view regenerate_command);
+
+// Write the includes, imports and module declarations of a source to output, only touching it when they changed
+void WriteSourceComponents(const fs::path& source, const fs::path& output);
@@ -0,0 +1,116 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <intern.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <deque>
+#include <shared_mutex>
+#include <unordered_map>
+#endif
+
+namespace
+{
+    struct NameTable
+    {
+        std::shared_mutex mutex;
+        Arena storage;
+        std::vector<std::string_view> names;
+        std::unordered_map<std::string_view, NameId> ids;
+    };
+
+    struct PathTable
+    {
+        std::shared_mutex mutex;
+        std::deque<fs::path> paths;
+        std::unordered_map<fs::path, PathId> ids;
+        // Paths as originally requested, avoids repeated absolute path conversions
+        std::unordered_map<fs::path, PathId> aliases;
+    };
+
+    NameTable& GetNameTable()
+    {
+        static NameTable table;
+        return table;
+    }
+
+    PathTable& GetPathTable()
+    {
+        static PathTable table;
+        return table;
+    }
+}
+
+NameId InternName(std::string_view name)
+{
+    auto& table = GetNameTable();
+
+    {
+        std::shared_lock lock{table.mutex};
+        auto iter = table.ids.find(name);
+        if (iter != table.ids.end()) return iter->second;
+    }
+
+    std::unique_lock lock{table.mutex};
+    auto iter = table.ids.find(name);
+    if (iter != table.ids.end()) return iter->second;
+
+    auto id = NameId(table.names.size());
+    auto stored = table.storage.Store(name);
+    table.names.emplace_back(stored);
+    table.ids.emplace(stored, id);
+    return id;
+}
+
+std::string_view NameToString(NameId id)
+{
+    auto& table = GetNameTable();
+    std::shared_lock lock{table.mutex};
+    return table.names.at(std::to_underlying(id));
+}
+
+uint32_t InternedNameCount()
+{
+    auto& table = GetNameTable();
+    std::shared_lock lock{table.mutex};
+    return uint32_t(table.names.size());
+}
+
+PathId InternPath(const fs::path& path)
+{
+    auto& table = GetPathTable();
+
+    {
+        std::shared_lock lock{table.mutex};
+        auto iter = table.aliases.find(path);
+        if (iter != table.aliases.end()) return iter->second;
+    }
+
+    auto normalized = fs::absolute(path).lexically_normal();
+
+    std::unique_lock lock{table.mutex};
+    auto iter = table.ids.find(normalized);
+    if (iter == table.ids.end()) {
+        auto id = PathId(table.paths.size());
+        iter = table.ids.emplace(normalized, id).first;
+        table.paths.emplace_back(std::move(normalized));
+    }
+    table.aliases.emplace(path, iter->second);
+    return iter->second;
+}
+
+const fs::path& PathFromId(PathId id)
+{
+    auto& table = GetPathTable();
+    std::shared_lock lock{table.mutex};
+    return table.paths.at(std::to_underlying(id));
+}
+
+uint32_t InternedPathCount()
+{
+    auto& table = GetPathTable();
+    std::shared_lock lock{table.mutex};
+    return uint32_t(table.paths.size());
+}
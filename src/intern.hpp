@@ -0,0 +1,40 @@
+#pragma once
+
+#include <core.hpp>
+
+// -----------------------------------------------------------------------------
+//  Global interning table for paths and logical module names
+//
+//  Interned values are assigned dense 32-bit IDs that remain valid for the
+//  lifetime of the process. Paths are interned in absolute, lexically normal
+//  form so that equal files always share an ID.
+// -----------------------------------------------------------------------------
+
+enum class NameId : uint32_t { Invalid = ~0u };
+enum class PathId : uint32_t { Invalid = ~0u };
+
+NameId InternName(std::string_view name);
+std::string_view NameToString(NameId id);
+uint32_t InternedNameCount();
+
+PathId InternPath(const fs::path& path);
+const fs::path& PathFromId(PathId id);
+uint32_t InternedPathCount();
+
+template<>
+struct std::formatter<NameId> : std::formatter<std::string_view>
+{
+    auto format(NameId id, std::format_context& ctx) const
+    {
+        return std::formatter<std::string_view>::format(NameToString(id), ctx);
+    }
+};
+
+template<>
+struct std::formatter<PathId> : std::formatter<std::string_view>
+{
+    auto format(PathId id, std::format_context& ctx) const
+    {
+        return std::formatter<std::string_view>::format(PathFromId(id).string(), ctx);
+    }
+};
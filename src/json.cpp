@@ -56,7 +56,7 @@ JsonValue JsonIterator::operator*() const noexcept
 // ---------------------------------------------------------------------------------------------------------------------
 
 const char* JsonValue::string() const noexcept { return yyjson_get_str(val); }
-std::optional<uint64_t> JsonValue::uint64() const noexcept { if (yyjson_is_int(val)) return yyjson_get_int(val); return std::nullopt; }
+std::optional<uint64_t> JsonValue::uint64() const noexcept { if (yyjson_is_uint(val)) return yyjson_get_uint(val); return std::nullopt; }
 std::optional<int64_t> JsonValue::int64() const noexcept { if (yyjson_is_sint(val)) return yyjson_get_sint(val); return std::nullopt; }
 std::optional<double> JsonValue::real() const noexcept { if (yyjson_is_real(val)) return yyjson_get_real(val); return std::nullopt; }
 bool JsonValue::obj() const noexcept { return yyjson_is_obj(val); }
@@ -72,14 +72,77 @@ JsonValue JsonValue::operator[](int64_t index) const noexcept { return JsonValue
 // ---------------------------------------------------------------------------------------------------------------------
 
 JsonDocument::JsonDocument(std::string_view json)
-    : doc(yyjson_read(json.data(), json.size(), YYJSON_READ_ALLOW_COMMENTS | YYJSON_READ_ALLOW_TRAILING_COMMAS))
+    : JsonDocument(json, std::nothrow)
 {
     if (!doc) Error("Error parsing json");
 }
 
+JsonDocument::JsonDocument(std::string_view json, std::nothrow_t) noexcept
+    : doc(yyjson_read(json.data(), json.size(), YYJSON_READ_ALLOW_COMMENTS | YYJSON_READ_ALLOW_TRAILING_COMMAS))
+{
+}
+
 JsonDocument::~JsonDocument()
 {
     yyjson_doc_free(doc);
 }
 
 JsonValue JsonDocument::root() const noexcept { return JsonValue(nullptr, yyjson_doc_get_root(doc)); }
+
+// ---------------------------------------------------------------------------------------------------------------------
+//         JsonWriter
+// ---------------------------------------------------------------------------------------------------------------------
+
+void JsonWriter::Separate()
+{
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+    if (!first_in_scope.empty()) {
+        if (!first_in_scope.back()) out += ',';
+        first_in_scope.back() = false;
+    }
+}
+
+JsonWriter& JsonWriter::BeginObject() { Separate(); out += '{'; first_in_scope.push_back(true); return *this; }
+JsonWriter& JsonWriter::EndObject() { out += '}'; first_in_scope.pop_back(); return *this; }
+JsonWriter& JsonWriter::BeginArray() { Separate(); out += '['; first_in_scope.push_back(true); return *this; }
+JsonWriter& JsonWriter::EndArray() { out += ']'; first_in_scope.pop_back(); return *this; }
+
+JsonWriter& JsonWriter::Key(std::string_view key)
+{
+    String(key);
+    out += ':';
+    after_key = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value)
+{
+    Separate();
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            break;case '"':  out += "\\\"";
+            break;case '\\': out += "\\\\";
+            break;case '\n': out += "\\n";
+            break;case '\r': out += "\\r";
+            break;case '\t': out += "\\t";
+            break;default:
+                if (uint8_t(c) < 0x20) {
+                    std::format_to(std::back_inserter(out), "\\u{:04x}", uint32_t(c));
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::Number(uint64_t value) { Separate(); std::format_to(std::back_inserter(out), "{}", value); return *this; }
+JsonWriter& JsonWriter::Number(int64_t value) { Separate(); std::format_to(std::back_inserter(out), "{}", value); return *this; }
+JsonWriter& JsonWriter::Number(double value) { Separate(); std::format_to(std::back_inserter(out), "{}", value); return *this; }
+JsonWriter& JsonWriter::Bool(bool value) { Separate(); out += value ? "true" : "false"; return *this; }
+JsonWriter& JsonWriter::Null() { Separate(); out += "null"; return *this; }
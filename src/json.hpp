@@ -3,6 +3,10 @@
 #ifndef HARMONY_USE_IMPORT_STD
 #include <iterator>
 #include <utility>
+#include <string>
+#include <vector>
+#include <concepts>
+#include <new>
 #endif
 
 struct yyjson_val;
@@ -91,7 +95,50 @@ struct JsonDocument
     yyjson_doc* doc = nullptr;
 
     JsonDocument(std::string_view json);
+    // Leaves the document empty on malformed input instead of raising an error
+    JsonDocument(std::string_view json, std::nothrow_t) noexcept;
     ~JsonDocument();
 
+    explicit operator bool() const noexcept { return doc; }
+
     JsonValue root() const noexcept;
 };
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Streaming JSON writer, appends compact JSON text to `out` without building an intermediate document
+struct JsonWriter
+{
+    std::string out;
+
+    JsonWriter& BeginObject();
+    JsonWriter& EndObject();
+    JsonWriter& BeginArray();
+    JsonWriter& EndArray();
+
+    JsonWriter& Key(std::string_view key);
+
+    JsonWriter& String(std::string_view value);
+    JsonWriter& Number(uint64_t value);
+    JsonWriter& Number(int64_t value);
+    JsonWriter& Number(double value);
+    JsonWriter& Bool(bool value);
+    JsonWriter& Null();
+
+    JsonWriter& Field(std::string_view key, std::string_view value) { return Key(key).String(value); }
+    JsonWriter& Field(std::string_view key, const char* value) { return Key(key).String(value); }
+    JsonWriter& Field(std::string_view key, std::integral auto value)
+    {
+        Key(key);
+        if constexpr (std::same_as<decltype(value), bool>) return Bool(value);
+        else if constexpr (std::is_signed_v<decltype(value)>) return Number(int64_t(value));
+        else return Number(uint64_t(value));
+    }
+    JsonWriter& Field(std::string_view key, double value) { return Key(key).Number(value); }
+
+private:
+    std::vector<bool> first_in_scope;
+    bool after_key = false;
+
+    void Separate();
+};
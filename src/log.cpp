@@ -5,4 +5,161 @@ import std.compat;
 
 #include "log.hpp"
 
+#ifndef HARMONY_USE_IMPORT_STD
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
 LogLevel log_level = LogLevel::Info;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+namespace
+{
+    std::atomic_bool log_writer_destroyed = false;
+
+    // Formatted lines from all threads in submission order, drained by a single writer thread. The queue is bounded,
+    // producers block while it is full
+    struct LogWriter
+    {
+        static constexpr size_t Capacity = 4096;
+
+        std::mutex mutex;
+        // Signalled when lines or a status update are queued, or on shutdown
+        std::condition_variable wake_writer;
+        // Signalled when the writer took queued lines or finished writing them
+        std::condition_variable wake_producers;
+        std::vector<std::string> queue;
+        bool writing = false;
+        bool stop = false;
+        std::thread thread;
+
+        // Status line, guarded by mutex
+        std::string status;
+        bool status_changed = false;
+        // Only accessed by the writer thread
+        bool status_shown = false;
+
+        LogWriter()
+        {
+            thread = std::thread([this] { Run(); });
+        }
+
+        ~LogWriter()
+        {
+            // Late log calls from other threads bypass the queue from here on
+            log_writer_destroyed = true;
+            {
+                std::scoped_lock lock{mutex};
+                stop = true;
+            }
+            wake_writer.notify_one();
+            thread.join();
+        }
+
+        void Run()
+        {
+            std::vector<std::string> lines;
+            for (;;) {
+                std::string cur_status;
+                {
+                    std::unique_lock lock{mutex};
+                    wake_writer.wait(lock, [&] { return stop || !queue.empty() || status_changed; });
+                    if (stop && queue.empty() && !status_changed) break;
+                    lines.swap(queue);
+                    status_changed = false;
+                    cur_status = status;
+                    writing = true;
+                }
+                wake_producers.notify_all();
+
+                // Clear the status line before new output, and redraw it below
+                if (status_shown) {
+                    std::fputs("\r\u001B[2K", stdout);
+                }
+                for (auto& line : lines) {
+                    std::fwrite(line.data(), 1, line.size(), stdout);
+                }
+                if (!cur_status.empty()) {
+                    std::fwrite(cur_status.data(), 1, cur_status.size(), stdout);
+                }
+                status_shown = !cur_status.empty();
+                std::fflush(stdout);
+                lines.clear();
+
+                {
+                    std::scoped_lock lock{mutex};
+                    writing = false;
+                }
+                wake_producers.notify_all();
+            }
+        }
+    };
+
+    LogWriter& GetLogWriter()
+    {
+        static LogWriter writer;
+        return writer;
+    }
+}
+
+namespace harmony::logging::detail
+{
+    void Submit(std::string&& line)
+    {
+        if (log_writer_destroyed) {
+            std::fwrite(line.data(), 1, line.size(), stdout);
+            return;
+        }
+
+        auto& writer = GetLogWriter();
+        {
+            std::unique_lock lock{writer.mutex};
+            writer.wake_producers.wait(lock, [&] { return writer.queue.size() < LogWriter::Capacity; });
+            writer.queue.emplace_back(std::move(line));
+        }
+        writer.wake_writer.notify_one();
+    }
+}
+
+bool LogIsTerminal()
+{
+    static bool is_terminal = isatty(fileno(stdout));
+    return is_terminal;
+}
+
+void LogStatus(std::string status)
+{
+    if (log_writer_destroyed || !LogIsTerminal()) return;
+
+    auto& writer = GetLogWriter();
+    {
+        std::scoped_lock lock{writer.mutex};
+        writer.status = std::move(status);
+        writer.status_changed = true;
+    }
+    writer.wake_writer.notify_one();
+}
+
+void LogFlush()
+{
+    if (log_writer_destroyed) return;
+
+    auto& writer = GetLogWriter();
+    std::unique_lock lock{writer.mutex};
+    writer.wake_producers.wait(lock, [&] {
+        return writer.queue.empty() && !writer.status_changed && !writer.writing;
+    });
+}
@@ -2,8 +2,9 @@
 
 #ifndef HARMONY_USE_IMPORT_STD
 #include <format>
-#include <syncstream>
 #include <iostream>
+#include <iterator>
+#include <string>
 #include <source_location>
 #endif
 
@@ -56,51 +57,79 @@ bool IsLogLevel(LogLevel level)
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+namespace harmony::logging::detail
+{
+    // Queue a fully formatted line on the shared log queue, lines are written in submission order by a background
+    // writer thread. Blocks while the queue is full
+    void Submit(std::string&& line);
+
+    template<class... Args>
+    void Format(std::string_view prefix, std::string_view fmt, Args&... args)
+    {
+        std::string line;
+        line.reserve(prefix.size() + fmt.size() + 32);
+        line += prefix;
+        std::vformat_to(std::back_inserter(line), fmt, std::make_format_args(args...));
+        line += EndLogLine;
+        Submit(std::move(line));
+    }
+}
+
+// Block until all queued log lines have been written
+void LogFlush();
+
+// True if log output is going to an interactive terminal
+bool LogIsTerminal();
+
+// Set a transient status line that is redrawn below regular log output. Only shown on terminals, pass an empty
+// string to clear
+void LogStatus(std::string status);
+
 template<class... Args>
 void Log(const LocatedFormatString<Args...> fmt, Args&&... args)
 {
-    std::osyncstream os(std::cout);
-    os << std::vformat(fmt.get(), std::make_format_args(args...)) << EndLogLine;
+    harmony::logging::detail::Format("", fmt.get(), args...);
 }
 
+// Define HARMONY_LOG_STRIP_DEBUG to compile out trace and debug logging, including evaluation of arguments
+#ifdef HARMONY_LOG_STRIP_DEBUG
+#define LogTrace(...) ((void)0)
+#define LogDebug(...) ((void)0)
+#else
 template<class... Args>
 void LogTrace(const LocatedFormatString<char, Args...> fmt, Args&&... args)
 {
     if (!IsLogLevel(LogLevel::Trace)) return;
-    std::osyncstream os(std::cout);
-    os << "[\u001B[90mTRACE\u001B[0m] \u001B[90m" << std::vformat(fmt.get(), std::make_format_args(args...)) << EndLogLine;
+    harmony::logging::detail::Format("[\u001B[90mTRACE\u001B[0m] \u001B[90m", fmt.get(), args...);
 }
 
 template<class... Args>
 void LogDebug(const LocatedFormatString<Args...> fmt, Args&&... args)
 {
     if (!IsLogLevel(LogLevel::Debug)) return;
-    std::osyncstream os(std::cout);
-    os << "[\u001B[96mDEBUG\u001B[0m] " << std::vformat(fmt.get(), std::make_format_args(args...)) << EndLogLine;
+    harmony::logging::detail::Format("[\u001B[96mDEBUG\u001B[0m] ", fmt.get(), args...);
 }
+#endif
 
 template<class... Args>
 void LogInfo(const LocatedFormatString<Args...> fmt, Args&&... args)
 {
     if (!IsLogLevel(LogLevel::Info)) return;
-    std::osyncstream os(std::cout);
-    os << "[\u001B[94mINFO\u001B[0m] " << std::vformat(fmt.get(), std::make_format_args(args...)) << EndLogLine;
+    harmony::logging::detail::Format("[\u001B[94mINFO\u001B[0m] ", fmt.get(), args...);
 }
 
 template<class... Args>
 void LogWarn(const LocatedFormatString<Args...> fmt, Args&&... args)
 {
     if (!IsLogLevel(LogLevel::Warn)) return;
-    std::osyncstream os(std::cout);
-    os << "[\u001B[93mWARN\u001B[0m] " << std::vformat(fmt.get(), std::make_format_args(args...)) << EndLogLine;
+    harmony::logging::detail::Format("[\u001B[93mWARN\u001B[0m] ", fmt.get(), args...);
 }
 
 template<class... Args>
 void LogError(const LocatedFormatString<Args...> fmt, Args&&... args)
 {
     if (!IsLogLevel(LogLevel::Error)) return;
-    std::osyncstream os(std::cout);
-    os << "[\u001B[91mERROR\u001B[0m] " << std::vformat(fmt.get(), std::make_format_args(args...)) << EndLogLine;
+    harmony::logging::detail::Format("[\u001B[91mERROR\u001B[0m] ", fmt.get(), args...);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
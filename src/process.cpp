@@ -0,0 +1,400 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#endif
+
+// popen/pclose
+#include <stdio.h>
+
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <process.hpp>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+namespace
+{
+    thread_local ResourceAccountingScope* current_accounting_scope = nullptr;
+}
+
+ResourceAccountingScope::ResourceAccountingScope()
+    : previous(current_accounting_scope)
+{
+    current_accounting_scope = this;
+}
+
+ResourceAccountingScope::~ResourceAccountingScope()
+{
+    current_accounting_scope = previous;
+    if (previous) {
+        previous->usage += usage;
+    }
+}
+
+void ResourceAccountingScope::Record(const ResourceUsage& usage)
+{
+    if (current_accounting_scope) {
+        current_accounting_scope->usage += usage;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+static
+int RunProcess(std::string cmdline, const fs::path& working_dir)
+{
+    auto start = chr::steady_clock::now();
+
+    // Run via a job object so that usage of all processes started by the command is accounted for
+    auto job = CreateJobObjectA(nullptr, nullptr);
+    if (!job) Error("Failed to create job object ({})", GetLastError());
+    HARMONY_DEFER(&) { CloseHandle(job); };
+
+    auto dir = working_dir.empty() ? std::string() : working_dir.string();
+
+    STARTUPINFOA startup_info{ .cb = sizeof(STARTUPINFOA) };
+    PROCESS_INFORMATION process_info{};
+    if (!CreateProcessA(nullptr, cmdline.data(), nullptr, nullptr, FALSE, CREATE_SUSPENDED, nullptr,
+            dir.empty() ? nullptr : dir.c_str(), &startup_info, &process_info)) {
+        LogError("Failed to start process ({}): {}", GetLastError(), cmdline);
+        return -1;
+    }
+    HARMONY_DEFER(&) {
+        CloseHandle(process_info.hThread);
+        CloseHandle(process_info.hProcess);
+    };
+
+    AssignProcessToJobObject(job, process_info.hProcess);
+    ResumeThread(process_info.hThread);
+    WaitForSingleObject(process_info.hProcess, INFINITE);
+
+    DWORD exit_code = 0;
+    GetExitCodeProcess(process_info.hProcess, &exit_code);
+
+    ResourceUsage usage;
+    usage.wall = chr::duration_cast<chr::nanoseconds>(chr::steady_clock::now() - start);
+
+    JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting{};
+    if (QueryInformationJobObject(job, JobObjectBasicAndIoAccountingInformation, &accounting, sizeof(accounting), nullptr)) {
+        // Reported in 100ns units
+        usage.user_cpu = chr::nanoseconds(accounting.BasicInfo.TotalUserTime.QuadPart * 100);
+        usage.system_cpu = chr::nanoseconds(accounting.BasicInfo.TotalKernelTime.QuadPart * 100);
+        usage.io_read = accounting.IoInfo.ReadTransferCount;
+        usage.io_write = accounting.IoInfo.WriteTransferCount;
+    }
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits{};
+    if (QueryInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits), nullptr)) {
+        usage.peak_memory = limits.PeakJobMemoryUsed;
+    }
+    usage.processes = 1;
+
+    ResourceAccountingScope::Record(usage);
+
+    return int(exit_code);
+}
+
+int RunCommand(const std::string& cmd, const fs::path& working_dir)
+{
+    return RunProcess(std::format("cmd.exe /c {}", cmd), working_dir);
+}
+
+int RunCommand(std::span<const char* const> args, const fs::path& working_dir)
+{
+    std::string cmdline;
+    for (auto arg : args) {
+        if (!cmdline.empty()) cmdline += ' ';
+        cmdline += QuoteArgument(arg);
+    }
+    return RunProcess(std::move(cmdline), working_dir);
+}
+
+std::string QuoteArgument(std::string_view arg)
+{
+    if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string_view::npos) return std::string(arg);
+
+    // Backslashes are only special when they precede a quote, following the MSVC runtime's parsing rules
+    std::string quoted = "\"";
+    uint32_t backslashes = 0;
+    for (auto c : arg) {
+        if (c == '\\') {
+            backslashes++;
+            continue;
+        }
+        quoted.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+        quoted += c;
+        backslashes = 0;
+    }
+    quoted.append(backslashes * 2, '\\');
+    quoted += '"';
+    return quoted;
+}
+
+std::string QuoteResponseFileArgument(std::string_view arg)
+{
+    return QuoteArgument(arg);
+}
+
+bool FitsCommandLine(std::span<const char* const> args)
+{
+    // CreateProcess limit including the terminator. Assume worst case quoting for every argument
+    constexpr size_t MaxLength = 32'767;
+
+    size_t length = 0;
+    for (auto arg : args) {
+        std::string_view view = arg;
+        length += view.size() + 3 + std::ranges::count_if(view, [](char c) { return c == '"' || c == '\\'; });
+    }
+    return length < MaxLength;
+}
+
+#else
+
+// Fork and execute argv in the child. If channel_fds are given they are duplicated onto the child channel descriptors
+static
+pid_t ForkExec(const char* const* argv, const std::string& dir, bool search_path, const int* channel_fds = nullptr)
+{
+    auto pid = fork();
+    if (pid != 0) return pid;
+
+    // Only async-signal-safe calls until exec, other threads may hold locks
+
+    if (channel_fds) {
+        // Move out of the way of the target descriptors first, in case a pipe end already occupies one
+        int read_fd = fcntl(channel_fds[0], F_DUPFD_CLOEXEC, ChildChannelWriteFd + 1);
+        int write_fd = fcntl(channel_fds[1], F_DUPFD_CLOEXEC, ChildChannelWriteFd + 1);
+        if (read_fd < 0 || write_fd < 0) _exit(127);
+        if (dup2(read_fd, ChildChannelReadFd) < 0 || dup2(write_fd, ChildChannelWriteFd) < 0) _exit(127);
+    }
+
+    if (!dir.empty() && chdir(dir.c_str()) != 0) _exit(127);
+
+    auto args = const_cast<char* const*>(argv);
+    if (search_path) execvp(argv[0], args);
+    else execv(argv[0], args);
+
+    constexpr std::string_view Message = "harmony: failed to execute ";
+    [[maybe_unused]] auto _ = write(STDERR_FILENO, Message.data(), Message.size());
+    _ = write(STDERR_FILENO, argv[0], std::strlen(argv[0]));
+    _ = write(STDERR_FILENO, "\n", 1);
+    _exit(127);
+}
+
+static
+int WaitForProcess(pid_t pid, chr::steady_clock::time_point start, std::string_view cmd)
+{
+    int status = 0;
+    rusage ru{};
+    while (wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) {
+            LogError("Failed to wait for process ({}): {}", errno, cmd);
+            return -1;
+        }
+    }
+
+    // Usage reported by wait4 includes descendants that the child waited for
+    auto ToNanos = [](const timeval& tv) {
+        return chr::seconds(tv.tv_sec) + chr::microseconds(tv.tv_usec);
+    };
+
+    ResourceUsage usage;
+    usage.wall = chr::duration_cast<chr::nanoseconds>(chr::steady_clock::now() - start);
+    usage.user_cpu = ToNanos(ru.ru_utime);
+    usage.system_cpu = ToNanos(ru.ru_stime);
+    usage.peak_memory = uint64_t(ru.ru_maxrss) * 1024;
+    usage.io_read = uint64_t(ru.ru_inblock) * 512;
+    usage.io_write = uint64_t(ru.ru_oublock) * 512;
+    usage.processes = 1;
+
+    ResourceAccountingScope::Record(usage);
+
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    return -1;
+}
+
+// Null terminated copy of an argument list, built before forking
+static
+std::vector<const char*> TerminatedArgs(std::span<const char* const> args)
+{
+    std::vector<const char*> argv(args.begin(), args.end());
+    argv.emplace_back(nullptr);
+    return argv;
+}
+
+int RunCommand(const std::string& cmd, const fs::path& working_dir)
+{
+    auto start = chr::steady_clock::now();
+
+    const char* argv[] = { "/bin/sh", "-c", cmd.c_str(), nullptr };
+    auto pid = ForkExec(argv, working_dir.string(), false);
+    if (pid < 0) {
+        LogError("Failed to start process ({}): {}", errno, cmd);
+        return -1;
+    }
+
+    return WaitForProcess(pid, start, cmd);
+}
+
+int RunCommand(std::span<const char* const> args, const fs::path& working_dir)
+{
+    auto start = chr::steady_clock::now();
+
+    auto argv = TerminatedArgs(args);
+    auto pid = ForkExec(argv.data(), working_dir.string(), true);
+    if (pid < 0) {
+        LogError("Failed to start process ({}): {}", errno, args[0]);
+        return -1;
+    }
+
+    return WaitForProcess(pid, start, args[0]);
+}
+
+int RunCommandWithChannel(std::span<const char* const> args, const fs::path& working_dir,
+    function_ref<void(int read_fd, int write_fd)> serve)
+{
+    auto start = chr::steady_clock::now();
+
+    // Writes to a child that exited early should fail with EPIPE instead of terminating Harmony
+    [[maybe_unused]] static const bool ignore_sigpipe = (signal(SIGPIPE, SIG_IGN), true);
+
+    auto argv = TerminatedArgs(args);
+
+    // All ends are close-on-exec, so that children started concurrently on other threads never inherit them and
+    // hold the channel open. The child's ends are duplicated onto the well known descriptors after fork
+    int to_child[2], from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0) {
+        LogError("Failed to create pipe ({}): {}", errno, args[0]);
+        return -1;
+    }
+    if (pipe2(from_child, O_CLOEXEC) != 0) {
+        LogError("Failed to create pipe ({}): {}", errno, args[0]);
+        close(to_child[0]);
+        close(to_child[1]);
+        return -1;
+    }
+
+    int channel_fds[] = { to_child[0], from_child[1] };
+    auto pid = ForkExec(argv.data(), working_dir.string(), true, channel_fds);
+    if (pid < 0) {
+        LogError("Failed to start process ({}): {}", errno, args[0]);
+        for (int fd : { to_child[0], to_child[1], from_child[0], from_child[1] }) close(fd);
+        return -1;
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+
+    serve(from_child[0], to_child[1]);
+
+    close(from_child[0]);
+    close(to_child[1]);
+
+    return WaitForProcess(pid, start, args[0]);
+}
+
+std::string QuoteArgument(std::string_view arg)
+{
+    auto IsPlain = [](char c) {
+        return std::isalnum(uint8_t(c)) || std::string_view("-_+=/.,:@%").contains(c);
+    };
+
+    if (!arg.empty() && std::ranges::all_of(arg, IsPlain)) return std::string(arg);
+
+    std::string quoted = "'";
+    for (auto c : arg) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    quoted += '\'';
+    return quoted;
+}
+
+std::string QuoteResponseFileArgument(std::string_view arg)
+{
+    auto IsPlain = [](char c) {
+        return std::isalnum(uint8_t(c)) || std::string_view("-_+=/.,:@%").contains(c);
+    };
+
+    if (!arg.empty() && std::ranges::all_of(arg, IsPlain)) return std::string(arg);
+
+    // GCC and Clang treat a backslash as an escape inside both quote styles, so single quoting alone is not enough
+    std::string quoted = "\"";
+    for (auto c : arg) {
+        if (c == '\\' || c == '"') quoted += '\\';
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+extern char** environ;
+
+bool FitsCommandLine(std::span<const char* const> args)
+{
+    // ARG_MAX covers arguments, environment and their pointer arrays
+    static const size_t available = [] {
+        size_t env_size = 0;
+        for (auto env = environ; *env; ++env) {
+            env_size += std::strlen(*env) + 1 + sizeof(char*);
+        }
+        auto arg_max = sysconf(_SC_ARG_MAX);
+        // Leave headroom for anything the program's own startup adds
+        constexpr size_t Headroom = 4096;
+        auto limit = arg_max > 0 ? size_t(arg_max) : size_t(128 * 1024);
+        return limit > env_size + Headroom ? limit - env_size - Headroom : 0;
+    }();
+
+    size_t length = 0;
+    for (auto arg : args) {
+        auto arg_length = std::strlen(arg) + 1;
+#ifdef __linux__
+        // Linux additionally limits each argument to MAX_ARG_STRLEN (32 pages)
+        if (arg_length > 32 * 4096) return false;
+#endif
+        length += arg_length + sizeof(char*);
+    }
+    return length < available;
+}
+
+#endif
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+std::optional<std::string> CaptureCommandOutput(const std::string& cmd)
+{
+    LogCmd(cmd);
+
+    auto pipe = popen(cmd.c_str(), "r");
+    if (!pipe) {
+        LogError("Failed to start process: {}", cmd);
+        return std::nullopt;
+    }
+
+    std::string output;
+    char buffer[4096];
+    while (auto read = std::fread(buffer, 1, sizeof(buffer), pipe)) {
+        output.append(buffer, read);
+    }
+
+    if (pclose(pipe) != 0) return std::nullopt;
+    return output;
+}
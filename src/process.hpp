@@ -0,0 +1,87 @@
+#pragma once
+
+#include <core.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <algorithm>
+#endif
+
+// -----------------------------------------------------------------------------
+//  Process execution with resource accounting
+// -----------------------------------------------------------------------------
+
+struct ResourceUsage
+{
+    chr::nanoseconds wall{};
+    chr::nanoseconds user_cpu{};
+    chr::nanoseconds system_cpu{};
+    uint64_t peak_memory = 0;
+    uint64_t io_read = 0;
+    uint64_t io_write = 0;
+    // Number of processes the usage was accumulated from
+    uint32_t processes = 0;
+
+    ResourceUsage& operator+=(const ResourceUsage& other)
+    {
+        wall += other.wall;
+        user_cpu += other.user_cpu;
+        system_cpu += other.system_cpu;
+        peak_memory = std::max(peak_memory, other.peak_memory);
+        io_read += other.io_read;
+        io_write += other.io_write;
+        processes += other.processes;
+        return *this;
+    }
+};
+
+// Accumulates the resource usage of every process run on the current thread while the scope is alive
+class ResourceAccountingScope
+{
+    ResourceUsage usage;
+    ResourceAccountingScope* previous;
+
+public:
+    ResourceAccountingScope();
+    ~ResourceAccountingScope();
+
+    ResourceAccountingScope(const ResourceAccountingScope&) = delete;
+    ResourceAccountingScope& operator=(const ResourceAccountingScope&) = delete;
+
+    const ResourceUsage& Usage() const noexcept { return usage; }
+
+    static void Record(const ResourceUsage& usage);
+};
+
+// Run a command line through the platform shell, optionally in a different working directory.
+// Returns the exit code of the process.
+int RunCommand(const std::string& cmd, const fs::path& working_dir = {});
+
+// Run a program directly without a shell, the program (args[0]) is searched for on the PATH.
+// Returns the exit code of the process.
+int RunCommand(std::span<const char* const> args, const fs::path& working_dir = {});
+
+// Quote an argument following the platform's command line conventions
+std::string QuoteArgument(std::string_view arg);
+
+// Quote an argument for a response file passed to the compiler. On Windows these follow the command line conventions,
+// elsewhere the GCC rules apply where backslashes escape the next character even inside quotes
+std::string QuoteResponseFileArgument(std::string_view arg);
+
+// Whether the arguments can be passed to a new process directly, within the OS command line limits
+bool FitsCommandLine(std::span<const char* const> args);
+
+#ifndef _WIN32
+// File descriptors on which a child started by RunCommandWithChannel reads from and writes to the parent
+inline constexpr int ChildChannelReadFd = 3;
+inline constexpr int ChildChannelWriteFd = 4;
+
+// Run a program without a shell with an extra pipe pair connected to the child. serve is called with the parent's
+// ends while the child runs, and should return once the child closes its write end.
+// Returns the exit code of the process.
+int RunCommandWithChannel(std::span<const char* const> args, const fs::path& working_dir,
+    function_ref<void(int read_fd, int write_fd)> serve);
+#endif
+
+// Run a command line through the platform shell and capture its standard output.
+// Returns nullopt if the command could not be started or exited with a non-zero code.
+std::optional<std::string> CaptureCommandOutput(const std::string& cmd);
@@ -0,0 +1,127 @@
+#ifdef HARMONY_USE_IMPORT_STD
+import std;
+import std.compat;
+#endif
+
+#include <trace.hpp>
+#include <json.hpp>
+
+#ifndef HARMONY_USE_IMPORT_STD
+#include <atomic>
+#include <mutex>
+#include <map>
+#endif
+
+namespace
+{
+    struct Event
+    {
+        std::string name;
+        std::string category;
+        std::string detail;
+        chr::steady_clock::time_point start;
+        chr::steady_clock::time_point end;
+        uint32_t lane;
+    };
+
+    struct TraceBuffer
+    {
+        std::atomic_bool enabled = false;
+        chr::steady_clock::time_point origin = chr::steady_clock::now();
+        std::mutex mutex;
+        std::vector<Event> events;
+        std::map<uint32_t, std::string> lane_names;
+    };
+
+    TraceBuffer& GetTraceBuffer()
+    {
+        static TraceBuffer buffer;
+        return buffer;
+    }
+}
+
+void EnableTracing()
+{
+    GetTraceBuffer().enabled = true;
+}
+
+bool IsTracingEnabled()
+{
+    return GetTraceBuffer().enabled.load(std::memory_order_relaxed);
+}
+
+void TraceEvent(std::string_view name, std::string_view category,
+    chr::steady_clock::time_point start, chr::steady_clock::time_point end,
+    uint32_t lane, std::string_view detail)
+{
+    auto& buffer = GetTraceBuffer();
+    if (!buffer.enabled.load(std::memory_order_relaxed)) return;
+
+    std::scoped_lock lock{buffer.mutex};
+    buffer.events.emplace_back(std::string(name), std::string(category), std::string(detail), start, end, lane);
+}
+
+void TraceLaneName(uint32_t lane, std::string_view name)
+{
+    auto& buffer = GetTraceBuffer();
+    if (!buffer.enabled.load(std::memory_order_relaxed)) return;
+
+    std::scoped_lock lock{buffer.mutex};
+    buffer.lane_names.try_emplace(lane, name);
+}
+
+void WriteTrace(const fs::path& path)
+{
+    auto& buffer = GetTraceBuffer();
+    std::scoped_lock lock{buffer.mutex};
+
+    LogInfo("Writing trace ({} events) to [{}]", buffer.events.size(), path.string());
+
+    auto ToMicros = [&](chr::steady_clock::time_point time) {
+        return chr::duration<double, std::micro>(time - buffer.origin).count();
+    };
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Field("displayTimeUnit", "ms");
+    json.Key("traceEvents").BeginArray();
+
+    json.BeginObject()
+        .Field("ph", "M").Field("name", "process_name").Field("pid", 1).Field("tid", 0)
+        .Key("args").BeginObject().Field("name", "harmony").EndObject()
+        .EndObject();
+
+    for (auto&[lane, name] : buffer.lane_names) {
+        json.BeginObject()
+            .Field("ph", "M").Field("name", "thread_name").Field("pid", 1).Field("tid", lane)
+            .Key("args").BeginObject().Field("name", name).EndObject()
+            .EndObject();
+        json.BeginObject()
+            .Field("ph", "M").Field("name", "thread_sort_index").Field("pid", 1).Field("tid", lane)
+            .Key("args").BeginObject().Field("sort_index", lane).EndObject()
+            .EndObject();
+    }
+
+    for (auto& event : buffer.events) {
+        json.BeginObject()
+            .Field("ph", "X")
+            .Field("name", event.name)
+            .Field("cat", event.category)
+            .Field("pid", 1)
+            .Field("tid", event.lane)
+            .Field("ts", ToMicros(event.start))
+            .Field("dur", chr::duration<double, std::micro>(event.end - event.start).count());
+        if (!event.detail.empty()) {
+            json.Key("args").BeginObject().Field("detail", event.detail).EndObject();
+        }
+        json.EndObject();
+    }
+
+    json.EndArray();
+    json.EndObject();
+
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path());
+    }
+    WriteStringToFile(path, json.out);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <core.hpp>
+
+// -----------------------------------------------------------------------------
+//  Chrome trace event profiling
+//
+//  Records complete ("X") events into an in-memory buffer which is written
+//  out as Chrome/Perfetto compatible JSON. Lanes map to trace thread IDs,
+//  lane 0 is the main thread and worker lanes are assigned by the scheduler.
+// -----------------------------------------------------------------------------
+
+void EnableTracing();
+bool IsTracingEnabled();
+
+void TraceEvent(std::string_view name, std::string_view category,
+    chr::steady_clock::time_point start, chr::steady_clock::time_point end,
+    uint32_t lane = 0, std::string_view detail = {});
+
+void TraceLaneName(uint32_t lane, std::string_view name);
+
+void WriteTrace(const fs::path& path);
+
+class TraceScope
+{
+    std::string_view name;
+    std::string_view category;
+    uint32_t lane;
+    chr::steady_clock::time_point start;
+
+public:
+    TraceScope(std::string_view _name, std::string_view _category = "phase", uint32_t _lane = 0)
+        : name(_name)
+        , category(_category)
+        , lane(_lane)
+        , start(chr::steady_clock::now())
+    {}
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope()
+    {
+        if (IsTracingEnabled()) {
+            TraceEvent(name, category, start, chr::steady_clock::now(), lane);
+        }
+    }
+};